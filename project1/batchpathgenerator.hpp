@@ -0,0 +1,213 @@
+
+/*! \file batchpathgenerator.hpp
+    \brief Generates blocks of log-normal paths in structure-of-arrays layout
+*/
+
+#ifndef batch_path_generator_hpp
+#define batch_path_generator_hpp
+
+#include <ql/methods/montecarlo/brownianbridge.hpp>
+#include <ql/stochasticprocess.hpp>
+#include <ql/timegrid.hpp>
+#include "mcarena.hpp"
+#include <algorithm>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace QuantLib {
+
+    namespace detail {
+
+        // y[j] = x[j] + m + s*z[j] for j in [0,n)
+        inline void logNormalStep(const double* x, const double* z,
+                                  double m, double s, double* y, Size n) {
+            Size j = 0;
+            #if defined(__AVX512F__)
+            const __m512d vm = _mm512_set1_pd(m), vs = _mm512_set1_pd(s);
+            for (; j+8 <= n; j += 8) {
+                __m512d vx = _mm512_add_pd(_mm512_loadu_pd(x+j), vm);
+                _mm512_storeu_pd(y+j,
+                                 _mm512_fmadd_pd(vs, _mm512_loadu_pd(z+j), vx));
+            }
+            #elif defined(__AVX2__) && defined(__FMA__)
+            const __m256d vm = _mm256_set1_pd(m), vs = _mm256_set1_pd(s);
+            for (; j+4 <= n; j += 4) {
+                __m256d vx = _mm256_add_pd(_mm256_loadu_pd(x+j), vm);
+                _mm256_storeu_pd(y+j,
+                                 _mm256_fmadd_pd(vs, _mm256_loadu_pd(z+j), vx));
+            }
+            #endif
+            for (; j<n; ++j)
+                y[j] = x[j] + m + s*z[j];
+        }
+
+        inline void logNormalStep(const float* x, const float* z,
+                                  double m, double s, float* y, Size n) {
+            Size j = 0;
+            #if defined(__AVX512F__)
+            const __m512 vm = _mm512_set1_ps(float(m)),
+                         vs = _mm512_set1_ps(float(s));
+            for (; j+16 <= n; j += 16) {
+                __m512 vx = _mm512_add_ps(_mm512_loadu_ps(x+j), vm);
+                _mm512_storeu_ps(y+j,
+                                 _mm512_fmadd_ps(vs, _mm512_loadu_ps(z+j), vx));
+            }
+            #elif defined(__AVX2__) && defined(__FMA__)
+            const __m256 vm = _mm256_set1_ps(float(m)),
+                         vs = _mm256_set1_ps(float(s));
+            for (; j+8 <= n; j += 8) {
+                __m256 vx = _mm256_add_ps(_mm256_loadu_ps(x+j), vm);
+                _mm256_storeu_ps(y+j,
+                                 _mm256_fmadd_ps(vs, _mm256_loadu_ps(z+j), vx));
+            }
+            #endif
+            for (; j<n; ++j)
+                y[j] = x[j] + float(m) + float(s)*z[j];
+        }
+
+    }
+
+
+    //! Generates batches of log-normal paths
+    /*! The paths of a batch are evolved together, one time step at a
+        time, over arrays holding the same time step of every path
+        (structure-of-arrays layout); the step is vectorized with
+        AVX2 or AVX-512 when the compiler targets them.  Values are
+        stored as the logarithm of \f$ S(t)/S(0) \f$ with type \c T,
+        so that single precision can be used to halve the memory
+        traffic; payoffs should still be accumulated in double.
+
+        All buffers are taken from the given arena when the generator
+        is built, so that generating paths does not allocate.  The
+        random sequences are drawn from the generator passed to
+        next(), which allows the same buffers to be reused with
+        different random streams.
+
+        The process must have a log-normal transition whose
+        coefficients do not depend on the state, as
+        ConstantBlackScholesProcess or a Black-Scholes process with
+        strike-independent volatility; the drift and standard
+        deviation of each step are read once from its evolve method.
+    */
+    template <class T = Real>
+    class BatchPathGenerator : private boost::noncopyable {
+      public:
+        typedef T storage_type;
+        BatchPathGenerator(
+                   const boost::shared_ptr<StochasticProcess1D>& process,
+                   const TimeGrid& timeGrid,
+                   bool brownianBridge,
+                   Size batchSize,
+                   McArena& arena);
+        //! draws and evolves the given number of paths
+        template <class GSG>
+        void next(GSG& generator, Size paths);
+        //! evolves the antithetic paths of the last batch
+        void antithetic();
+        //! \name Inspectors
+        //@{
+        Size batchSize() const { return batchSize_; }
+        Size paths() const { return paths_; }
+        Size timeSteps() const { return steps_; }
+        const TimeGrid& timeGrid() const { return timeGrid_; }
+        //! Gaussian draws of the i-th step for the paths of the batch
+        const T* draws(Size i) const {
+            return draws_ + i*batchSize_;
+        }
+        //! logarithms of S(t_i)/S(0) for the paths of the batch
+        const T* logValues(Size i) const {
+            return logValues_ + i*batchSize_;
+        }
+        Real value(Size i, Size path) const {
+            return x0_ * std::exp(Real(logValues(i)[path]));
+        }
+        Real weight(Size path) const { return weights_[path]; }
+        //@}
+      private:
+        void evolve(Real sign);
+        TimeGrid timeGrid_;
+        BrownianBridge bb_;
+        bool brownianBridge_;
+        Size steps_, batchSize_, paths_;
+        Real x0_;
+        Real *drift_, *stdDev_, *weights_, *temp_;
+        T *draws_, *logValues_;
+    };
+
+
+    // template definitions
+
+    template <class T>
+    BatchPathGenerator<T>::BatchPathGenerator(
+                   const boost::shared_ptr<StochasticProcess1D>& process,
+                   const TimeGrid& timeGrid,
+                   bool brownianBridge,
+                   Size batchSize,
+                   McArena& arena)
+    : timeGrid_(timeGrid), bb_(timeGrid), brownianBridge_(brownianBridge),
+      steps_(timeGrid.size()-1), batchSize_(batchSize), paths_(0),
+      x0_(process->x0()),
+      drift_(arena.allocate<Real>(steps_)),
+      stdDev_(arena.allocate<Real>(steps_)),
+      weights_(arena.allocate<Real>(batchSize)),
+      temp_(arena.allocate<Real>(steps_)),
+      draws_(arena.allocate<T>(steps_*batchSize)),
+      logValues_(arena.allocate<T>((steps_+1)*batchSize)) {
+        QL_REQUIRE(batchSize > 0, "null batch size given");
+        std::fill(logValues_, logValues_+batchSize_, T(0.0));
+        for (Size i=0; i<steps_; ++i) {
+            Time t = timeGrid_[i], dt = timeGrid_.dt(i);
+            drift_[i] = std::log(process->evolve(t, 1.0, dt, 0.0));
+            stdDev_[i] = std::log(process->evolve(t, 1.0, dt, 1.0))
+                         - drift_[i];
+        }
+    }
+
+    template <class T>
+    template <class GSG>
+    void BatchPathGenerator<T>::next(GSG& generator, Size paths) {
+        QL_REQUIRE(paths <= batchSize_,
+                   "too many paths (" << paths << ") requested; "
+                   "batch size is " << batchSize_);
+        QL_REQUIRE(generator.dimension() == steps_,
+                   "dimension (" << generator.dimension()
+                   << ") is not equal to the number of time steps ("
+                   << steps_ << ")");
+        typedef typename GSG::sample_type sequence_type;
+
+        for (Size j=0; j<paths; ++j) {
+            const sequence_type& sequence = generator.nextSequence();
+            weights_[j] = sequence.weight;
+            const Real* z = &sequence.value[0];
+            if (brownianBridge_) {
+                bb_.transform(sequence.value.begin(), sequence.value.end(),
+                              temp_);
+                z = temp_;
+            }
+            for (Size i=0; i<steps_; ++i)
+                draws_[i*batchSize_+j] = T(z[i]);
+        }
+        paths_ = paths;
+        evolve(1.0);
+    }
+
+    template <class T>
+    void BatchPathGenerator<T>::antithetic() {
+        evolve(-1.0);
+    }
+
+    template <class T>
+    void BatchPathGenerator<T>::evolve(Real sign) {
+        for (Size i=0; i<steps_; ++i)
+            detail::logNormalStep(logValues_ + i*batchSize_,
+                                  draws_ + i*batchSize_,
+                                  drift_[i], sign*stdDev_[i],
+                                  logValues_ + (i+1)*batchSize_,
+                                  paths_);
+    }
+
+}
+
+
+#endif
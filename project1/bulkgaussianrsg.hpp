@@ -0,0 +1,194 @@
+/*! \file bulkgaussianrsg.hpp
+    \brief Vectorized generation of Gaussian variates
+*/
+
+#ifndef bulk_gaussian_rsg_hpp
+#define bulk_gaussian_rsg_hpp
+
+#include <ql/math/randomnumbers/randomsequencegenerator.hpp>
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <ql/errors.hpp>
+#include "philoxrsg.hpp"
+#include <cmath>
+#include <vector>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace QuantLib {
+
+    namespace detail {
+
+        // coefficients of Acklam's approximation, as used by
+        // InverseCumulativeNormal
+        const double icnA[] = { -3.969683028665376e+01,
+                                 2.209460984245205e+02,
+                                -2.759285104469687e+02,
+                                 1.383577518672690e+02,
+                                -3.066479806614716e+01,
+                                 2.506628277459239e+00 };
+        const double icnB[] = { -5.447609879822406e+01,
+                                 1.615858368580409e+02,
+                                -1.556989798598866e+02,
+                                 6.680131188771972e+01,
+                                -1.328068155288572e+01 };
+        const double icnC[] = { -7.784894002430293e-03,
+                                -3.223964580411365e-01,
+                                -2.400758277161838e+00,
+                                -2.549732539343734e+00,
+                                 4.374664141464968e+00,
+                                 2.938163982698783e+00 };
+        const double icnD[] = {  7.784695709041462e-03,
+                                 3.224671290700398e-01,
+                                 2.445134137142996e+00,
+                                 3.754408661907416e+00 };
+        const double icnLow = 0.02425, icnHigh = 1.0 - icnLow;
+
+        inline double icnCentral(double u) {
+            double q = u - 0.5, r = q*q;
+            return (((((icnA[0]*r+icnA[1])*r+icnA[2])*r+icnA[3])*r
+                     +icnA[4])*r+icnA[5])*q /
+                (((((icnB[0]*r+icnB[1])*r+icnB[2])*r+icnB[3])*r
+                  +icnB[4])*r+1.0);
+        }
+
+        inline double icnTail(double u) {
+            QL_REQUIRE(u > 0.0 && u < 1.0,
+                       "argument (" << u << ") out of range (0.0, 1.0)");
+            double v = (u < 0.5 ? u : 1.0 - u);
+            double s = std::sqrt(-2.0*std::log(v));
+            double z = (((((icnC[0]*s+icnC[1])*s+icnC[2])*s+icnC[3])*s
+                         +icnC[4])*s+icnC[5]) /
+                ((((icnD[0]*s+icnD[1])*s+icnD[2])*s+icnD[3])*s+1.0);
+            return (u < 0.5 ? z : -z);
+        }
+
+    }
+
+    //! Inverse cumulative normal of an array of uniform variates
+    /*! Uses the same approximation as InverseCumulativeNormal (with
+        no refinement).  The central region, where about 95% of the
+        variates fall, is evaluated on all the array with AVX2 or
+        AVX-512 when the compiler targets them; a second pass
+        evaluates the tails, which need a logarithm, one value at a
+        time.  The results agree with the scalar implementation to
+        within \f$ 10^{-12} \f$, relative to the variate when it is
+        larger than 1 in absolute value; fused multiply-adds change
+        the rounding of the central rational function, which loses a
+        few digits to cancellation near the ends of its range.
+
+        \pre all uniforms must be in (0,1).
+    */
+    inline void bulkInverseCumulativeNormal(const Real* u, Real* z, Size n) {
+        using namespace detail;
+        Size j = 0;
+        #if defined(__AVX512F__)
+        const __m512d half = _mm512_set1_pd(0.5), one = _mm512_set1_pd(1.0);
+        for (; j+8 <= n; j += 8) {
+            __m512d q = _mm512_sub_pd(_mm512_loadu_pd(u+j), half);
+            __m512d r = _mm512_mul_pd(q, q);
+            __m512d num = _mm512_set1_pd(icnA[0]);
+            for (int k=1; k<6; ++k)
+                num = _mm512_fmadd_pd(num, r, _mm512_set1_pd(icnA[k]));
+            __m512d den = _mm512_set1_pd(icnB[0]);
+            for (int k=1; k<5; ++k)
+                den = _mm512_fmadd_pd(den, r, _mm512_set1_pd(icnB[k]));
+            den = _mm512_fmadd_pd(den, r, one);
+            _mm512_storeu_pd(z+j,
+                             _mm512_div_pd(_mm512_mul_pd(num, q), den));
+        }
+        #elif defined(__AVX2__) && defined(__FMA__)
+        const __m256d half = _mm256_set1_pd(0.5), one = _mm256_set1_pd(1.0);
+        for (; j+4 <= n; j += 4) {
+            __m256d q = _mm256_sub_pd(_mm256_loadu_pd(u+j), half);
+            __m256d r = _mm256_mul_pd(q, q);
+            __m256d num = _mm256_set1_pd(icnA[0]);
+            for (int k=1; k<6; ++k)
+                num = _mm256_fmadd_pd(num, r, _mm256_set1_pd(icnA[k]));
+            __m256d den = _mm256_set1_pd(icnB[0]);
+            for (int k=1; k<5; ++k)
+                den = _mm256_fmadd_pd(den, r, _mm256_set1_pd(icnB[k]));
+            den = _mm256_fmadd_pd(den, r, one);
+            _mm256_storeu_pd(z+j,
+                             _mm256_div_pd(_mm256_mul_pd(num, q), den));
+        }
+        #endif
+        for (; j<n; ++j)
+            z[j] = icnCentral(u[j]);
+        for (j=0; j<n; ++j) {
+            if (u[j] < icnLow || u[j] > icnHigh)
+                z[j] = icnTail(u[j]);
+        }
+    }
+
+
+    //! Gaussian random-sequence generator with bulk transformation
+    /*! Same as InverseCumulativeRsg with InverseCumulativeNormal, but
+        each uniform sequence is transformed as a whole by
+        bulkInverseCumulativeNormal().
+    */
+    template <class USG>
+    class BulkGaussianRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit BulkGaussianRsg(const USG& uniformSequenceGenerator)
+        : dimension_(uniformSequenceGenerator.dimension()),
+          generator_(uniformSequenceGenerator),
+          x_(std::vector<Real>(dimension_), 1.0) {}
+        const sample_type& nextSequence() const {
+            const typename USG::sample_type& sample =
+                generator_.nextSequence();
+            x_.weight = sample.weight;
+            bulkInverseCumulativeNormal(&sample.value[0], &x_.value[0],
+                                        dimension_);
+            return x_;
+        }
+        const sample_type& lastSequence() const { return x_; }
+        Size dimension() const { return dimension_; }
+        //! only available for counter-based uniform generators
+        void skipTo(boost::uint64_t path) { generator_.skipTo(path); }
+        //! only available for reseedable uniform generators
+        void reseed(BigNatural seed) { generator_.reseed(seed); }
+      private:
+        Size dimension_;
+        USG generator_;
+        mutable sample_type x_;
+    };
+
+
+    //! pseudo-random traits with bulk Gaussian transformation
+    template <class USG>
+    struct GenericBulkGaussian {
+        // typedefs
+        typedef USG ursg_type;
+        typedef BulkGaussianRsg<ursg_type> rsg_type;
+        // more traits
+        enum { allowsErrorEstimate = 1 };
+        // factory
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed) {
+            ursg_type g(dimension, seed);
+            return rsg_type(g);
+        }
+        /*! returns a generator starting from the given path; only
+            available for counter-based uniform generators */
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                boost::uint64_t firstPath) {
+            ursg_type g(dimension, seed, firstPath);
+            return rsg_type(g);
+        }
+    };
+
+    //! Mersenne-twister uniforms with bulk Gaussian transformation
+    typedef GenericBulkGaussian<
+                RandomSequenceGenerator<MersenneTwisterUniformRng> >
+                                                            BulkPseudoRandom;
+    //! Philox uniforms with bulk Gaussian transformation
+    typedef GenericBulkGaussian<PhiloxUniformRsg> BulkCounterBased;
+
+}
+
+
+#endif
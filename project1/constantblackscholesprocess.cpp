@@ -1,3 +0,0 @@
-
-#include "constantblackscholesprocess.hpp"
-
@@ -0,0 +1,101 @@
+
+/*! \file controlvariatestatistics.hpp
+    \brief Statistics of a Monte Carlo sample and its control variate
+*/
+
+#ifndef control_variate_statistics_hpp
+#define control_variate_statistics_hpp
+
+#include <ql/errors.hpp>
+#include <ql/types.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace QuantLib {
+
+    //! Statistics of a sample and of its control variate
+    /*! Accumulates the weighted means, variances and covariance of
+        the pairs \f$ (y,c) \f$ with one-pass updates, and returns the
+        control-variate estimate of the mean of \f$ y \f$,
+        \f[
+            \bar{y} - \beta (\bar{c} - E[c]),
+        \f]
+        where the optimal coefficient
+        \f$ \beta = \mathrm{Cov}(y,c)/\mathrm{Var}(c) \f$ is estimated
+        from the samples added so far.
+    */
+    class ControlVariateStatistics {
+      public:
+        ControlVariateStatistics() { reset(); }
+        //! \name Inspectors
+        //@{
+        Size samples() const { return samples_; }
+        Real weightSum() const { return weightSum_; }
+        //! optimal coefficient of the control variate
+        Real coefficient() const {
+            return ccSum_ > 0.0 ? ycSum_/ccSum_ : 0.0;
+        }
+        //! controlled estimate of the mean, given the control mean
+        Real mean(Real controlMean) const {
+            QL_REQUIRE(samples_ > 0, "empty sample set");
+            return yMean_ - coefficient()*(cMean_ - controlMean);
+        }
+        //! variance of the uncontrolled sample
+        Real uncontrolledVariance() const {
+            return normalized(yySum_);
+        }
+        //! variance of the controlled sample
+        Real variance() const {
+            Real residual = yySum_;
+            if (ccSum_ > 0.0)
+                residual -= ycSum_*ycSum_/ccSum_;
+            return normalized(std::max<Real>(residual, 0.0));
+        }
+        Real errorEstimate() const {
+            return std::sqrt(variance()/samples_);
+        }
+        /*! ratio of the uncontrolled to the controlled variance;
+            QL_MAX_REAL is returned for a perfect control. */
+        Real varianceReductionFactor() const {
+            Real controlled = variance();
+            return controlled > 0.0 ? uncontrolledVariance()/controlled
+                                    : QL_MAX_REAL;
+        }
+        //@}
+        //! \name Modifiers
+        //@{
+        //! samples with null weight don't change the statistics
+        void add(Real y, Real c, Real weight = 1.0) {
+            QL_REQUIRE(weight >= 0.0, "negative weight not allowed");
+            // the updates below would divide by a null weight sum
+            if (weight == 0.0)
+                return;
+            ++samples_;
+            weightSum_ += weight;
+            Real dy = y - yMean_, dc = c - cMean_;
+            yMean_ += dy*weight/weightSum_;
+            cMean_ += dc*weight/weightSum_;
+            yySum_ += weight*dy*(y - yMean_);
+            ccSum_ += weight*dc*(c - cMean_);
+            ycSum_ += weight*dy*(c - cMean_);
+        }
+        void reset() {
+            samples_ = 0;
+            weightSum_ = yMean_ = cMean_ = yySum_ = ccSum_ = ycSum_ = 0.0;
+        }
+        //@}
+      private:
+        // same normalization as GeneralStatistics::variance
+        Real normalized(Real sum) const {
+            QL_REQUIRE(samples_ > 1,
+                       "sample number <= 1, unsufficient");
+            return sum/weightSum_ * samples_/(samples_-1.0);
+        }
+        Size samples_;
+        Real weightSum_, yMean_, cMean_, yySum_, ccSum_, ycSum_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,83 @@
+
+#include "gridblackscholesprocess.hpp"
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+
+namespace QuantLib {
+
+    GridBlackScholesProcess::GridBlackScholesProcess(
+              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+              const TimeGrid& grid,
+              Size spotPoints,
+              Real spotStdDevs)
+    : x0_(process->x0()), grid_(grid), uniform_(true), invDt_(0.0),
+      tolerance_(0.0), spotPoints_(0), logSpotMin_(0.0),
+      invLogSpotStep_(0.0) {
+        QL_REQUIRE(grid.size() > 1, "at least one time step required");
+        Size steps = grid.size()-1;
+        Time maturity = grid.back();
+
+        dt_.resize(steps);
+        sqrtDt_.resize(steps);
+        for (Size i=0; i<steps; ++i) {
+            dt_[i] = grid.dt(i);
+            sqrtDt_[i] = std::sqrt(dt_[i]);
+            if (std::fabs(dt_[i] - dt_[0]) > 1.0e-10*maturity)
+                uniform_ = false;
+        }
+        invDt_ = 1.0/dt_[0];
+        // well below any step, well above rounding
+        tolerance_ = 1.0e-10*maturity;
+
+        const YieldTermStructure& riskFree = **process->riskFreeRate();
+        const YieldTermStructure& dividends = **process->dividendYield();
+        drift_.resize(steps);
+        for (Size i=0; i<steps; ++i)
+            drift_[i] = std::log(riskFree.discount(grid[i]) *
+                                 dividends.discount(grid[i+1]) /
+                                 (riskFree.discount(grid[i+1]) *
+                                  dividends.discount(grid[i])));
+
+        boost::shared_ptr<BlackVolTermStructure> vol =
+            process->blackVolatility().currentLink();
+        if (boost::dynamic_pointer_cast<BlackConstantVol>(vol) ||
+            boost::dynamic_pointer_cast<BlackVarianceCurve>(vol)) {
+            // the strike is irrelevant
+            variance_.resize(steps);
+            stdDev_.resize(steps);
+            Real previous = vol->blackVariance(grid[0], x0_, true);
+            for (Size i=0; i<steps; ++i) {
+                Real next = vol->blackVariance(grid[i+1], x0_, true);
+                variance_[i] = std::max<Real>(next - previous, 0.0);
+                stdDev_[i] = std::sqrt(variance_[i]);
+                previous = next;
+            }
+            return;
+        }
+
+        QL_REQUIRE(spotPoints > 1, "at least two spot points required");
+        QL_REQUIRE(spotStdDevs > 0.0, "non-positive spot range given");
+        spotPoints_ = spotPoints;
+        // spots around the forward at maturity
+        Real logForward = std::log(x0_) + std::log(
+                  dividends.discount(maturity)/riskFree.discount(maturity));
+        Real stdDev = vol->blackVol(maturity, x0_, true)
+                    * std::sqrt(maturity);
+        Real halfWidth = std::max<Real>(spotStdDevs*stdDev,
+                                        std::fabs(logForward -
+                                                  std::log(x0_)));
+        logSpotMin_ = logForward - halfWidth;
+        Real logSpotStep = 2.0*halfWidth/(spotPoints_-1);
+        invLogSpotStep_ = 1.0/logSpotStep;
+
+        const LocalVolTermStructure& localVol =
+            **process->localVolatility();
+        localVols_.resize(steps*spotPoints_);
+        for (Size i=0; i<steps; ++i)
+            for (Size j=0; j<spotPoints_; ++j)
+                localVols_[i*spotPoints_+j] = localVol.localVol(
+                    grid[i], std::exp(logSpotMin_ + j*logSpotStep), true);
+    }
+
+}
+
@@ -0,0 +1,140 @@
+/*! \file gridblackscholesprocess.hpp
+    \brief Black-Scholes process tabulated on a time grid
+*/
+
+#ifndef grid_black_scholes_process_hpp
+#define grid_black_scholes_process_hpp
+
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/timegrid.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Black-Scholes process tabulated on a time grid
+    /*! This class samples the rates and volatility of a
+        GeneralizedBlackScholesProcess once, on the steps of the given
+        time grid, so that evolving the underlying along the grid only
+        takes table lookups instead of term-structure queries.
+
+        When the volatility is strike-independent (BlackConstantVol
+        or BlackVarianceCurve), the steps are exact: the log-increment
+        over step \f$ i \f$ has mean
+        \f$ \ln(D_r(t_i) D_q(t_{i+1}) / D_r(t_{i+1}) D_q(t_i))
+            - v_i/2 \f$ and variance
+        \f$ v_i = \sigma^2(t_{i+1}) t_{i+1} - \sigma^2(t_i) t_i \f$,
+        as in the original process.  Otherwise, the local volatility
+        is tabulated at the start of each step on a grid of spots,
+        evenly spaced in log-spot around the forward at the end of
+        the grid, and interpolated linearly in log-spot (with flat
+        extrapolation) during an Euler step in log-spot.
+
+        As in GeneralizedBlackScholesProcess, drift and diffusion
+        refer to the logarithm of the underlying.  The process can
+        only be evolved along its grid; uniform grids are looked up
+        in constant time.
+
+        \ingroup processes
+    */
+    class GridBlackScholesProcess : public StochasticProcess1D {
+      public:
+        GridBlackScholesProcess(
+               const boost::shared_ptr<GeneralizedBlackScholesProcess>&,
+               const TimeGrid& grid,
+               Size spotPoints = 201,
+               Real spotStdDevs = 5.0);
+        //! \name StochasticProcess1D interface
+        //@{
+        Real x0() const { return x0_; }
+        Real drift(Time t, Real x) const {
+            Size i = step(t);
+            Real sigma = volatility(i, x);
+            return drift_[i]/dt_[i] - 0.5*sigma*sigma;
+        }
+        Real diffusion(Time t, Real x) const {
+            return volatility(step(t), x);
+        }
+        Real apply(Real x0, Real dx) const { return x0 * std::exp(dx); }
+        /*! \note this is the expected value of the underlying, not of
+                  its logarithm. */
+        Real expectation(Time t, Real x0, Time dt) const {
+            return x0 * std::exp(drift_[step(t, dt)]);
+        }
+        Real stdDeviation(Time t, Real x0, Time dt) const {
+            Size i = step(t, dt);
+            return volatility(i, x0) * sqrtDt_[i];
+        }
+        Real variance(Time t, Real x0, Time dt) const {
+            Real s = stdDeviation(t, x0, dt);
+            return s*s;
+        }
+        Real evolve(Time t, Real x0, Time dt, Real dw) const {
+            Size i = step(t, dt);
+            if (spotPoints_ == 0)
+                return x0 * std::exp(drift_[i] - 0.5*variance_[i]
+                                     + stdDev_[i]*dw);
+            Real sigma = localVolatility(i, x0);
+            return x0 * std::exp(drift_[i] - 0.5*sigma*sigma*dt_[i]
+                                 + sigma*sqrtDt_[i]*dw);
+        }
+        //@}
+        //! \name Inspectors
+        //@{
+        const TimeGrid& timeGrid() const { return grid_; }
+        //! whether the volatility depends on the underlying
+        bool spotDependent() const { return spotPoints_ > 0; }
+        //@}
+      private:
+        // index of the grid step starting at t (and lasting dt)
+        Size step(Time t) const {
+            Size i;
+            if (uniform_)
+                i = Size(t*invDt_ + 0.5);
+            else
+                i = std::upper_bound(grid_.begin(), grid_.end(),
+                                     t + tolerance_) - grid_.begin() - 1;
+            QL_REQUIRE(i < dt_.size() &&
+                       std::fabs(grid_[i] - t) <= tolerance_,
+                       "time " << t << " is not on the process grid");
+            return i;
+        }
+        Size step(Time t, Time dt) const {
+            Size i = step(t);
+            QL_REQUIRE(std::fabs(dt_[i] - dt) <= tolerance_,
+                       "step " << dt << " from " << t
+                       << " does not match the process grid");
+            return i;
+        }
+        Real volatility(Size i, Real x) const {
+            return spotPoints_ == 0 ? stdDev_[i]/sqrtDt_[i]
+                                    : localVolatility(i, x);
+        }
+        Real localVolatility(Size i, Real x) const {
+            Real u = (std::log(x) - logSpotMin_)*invLogSpotStep_;
+            const Real* row = &localVols_[i*spotPoints_];
+            if (u <= 0.0)
+                return row[0];
+            if (u >= Real(spotPoints_-1))
+                return row[spotPoints_-1];
+            Size j = Size(u);
+            Real w = u - j;
+            return row[j] + w*(row[j+1] - row[j]);
+        }
+        Real x0_;
+        TimeGrid grid_;
+        bool uniform_;
+        Real invDt_, tolerance_;
+        std::vector<Real> dt_, sqrtDt_, drift_;
+        // strike-independent volatility
+        std::vector<Real> variance_, stdDev_;
+        // local volatility, one row of spots per step
+        Size spotPoints_;
+        Real logSpotMin_, invLogSpotStep_;
+        std::vector<Real> localVols_;
+    };
+
+}
+
+
+#endif
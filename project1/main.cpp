@@ -1,17 +1,977 @@
 
 #include "constantblackscholesprocess.hpp"
+#include "mcallocationcounter.hpp"
+#include "mcamericanengine.hpp"
+#include "mccheckpoint.hpp"
+#include "mcdrawstore.hpp"
 #include "mceuropeanengine.hpp"
+#include "mcportfolio.hpp"
+#include "mcshardresult.hpp"
+#include "mcspecializedeuropeanengine.hpp"
+#include "mlmceuropeanengine.hpp"
+#include "multipathpricer.hpp"
+#include "streamingstatistics.hpp"
 #include <ql/pricingengines/vanilla/mceuropeanengine.hpp>
 #include <ql/quantlib.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace QuantLib;
 
+// counted so that the sample loop can be checked not to allocate
+void* operator new(std::size_t size) {
+    McAllocationCounter::add();
+    if (void* p = std::malloc(size != 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    Size widths[] = { 35, 14, 14, 14, 16 };
+
+    // prices the option with the given engine and reports the
+    // sampling throughput (wall-clock time, since some of the
+    // engines use several threads); if no number of samples is
+    // given, the one returned by the engine is used
+    void report(const std::string& method,
+                VanillaOption& option,
+                const boost::shared_ptr<PricingEngine>& engine,
+                Size samples = Null<Size>()) {
+        option.setPricingEngine(engine);
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        Real npv = option.NPV();
+        Real error = option.errorEstimate();
+        double seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        if (samples == Null<Size>())
+            samples = option.result<Size>("samples");
+        std::cout << std::setw(widths[0]) << std::left << method
+                  << std::fixed << std::setprecision(6)
+                  << std::setw(widths[1]) << std::left << npv
+                  << std::setw(widths[2]) << std::left << error
+                  << std::setw(widths[3]) << std::left << seconds
+                  << std::setprecision(0)
+                  << std::setw(widths[4]) << std::left << samples/seconds
+                  << std::endl;
+    }
+
+    // cuts the file to the given fraction of its size, as a write
+    // interrupted by preemption would
+    void cutFile(const std::string& fileName, Real fraction) {
+        std::ifstream in(fileName.c_str(), std::ios_base::binary);
+        std::string contents((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+        in.close();
+        std::ofstream out(fileName.c_str(),
+                          std::ios_base::binary | std::ios_base::trunc);
+        out.write(contents.data(), std::streamsize(contents.size()*fraction));
+    }
+
+    // runs the task of each shard in a child process where possible,
+    // as a local stand-in for batch nodes, and in turn otherwise
+    void runShards(Size shards, const std::function<void(Size)>& task) {
+        std::cout.flush();
+        #if defined(__unix__) || defined(__APPLE__)
+        std::vector<pid_t> children;
+        for (Size k=0; k<shards; ++k) {
+            pid_t pid = fork();
+            QL_REQUIRE(pid >= 0, "cannot start shard " << k);
+            if (pid == 0) {
+                int status = 0;
+                try {
+                    task(k);
+                } catch (std::exception& e) {
+                    std::cerr << "shard " << k << ": " << e.what()
+                              << std::endl;
+                    status = 1;
+                }
+                _exit(status);
+            }
+            children.push_back(pid);
+        }
+        for (Size k=0; k<shards; ++k) {
+            int status = 0;
+            waitpid(children[k], &status, 0);
+            QL_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                       "shard " << k << " failed");
+        }
+        #else
+        for (Size k=0; k<shards; ++k)
+            task(k);
+        #endif
+    }
+
+}
+
 int main() {
 
     try {
 
-        // add your code here
+        Calendar calendar = TARGET();
+        Date todaysDate(15, May, 1998);
+        Date settlementDate(17, May, 1998);
+        Settings::instance().evaluationDate() = todaysDate;
+
+        Option::Type type(Option::Put);
+        Real underlying = 36;
+        Real strike = 40;
+        Spread dividendYield = 0.00;
+        Rate riskFreeRate = 0.06;
+        Volatility volatility = 0.20;
+        Date maturity(17, May, 1999);
+        DayCounter dayCounter = Actual365Fixed();
+
+        Handle<Quote> underlyingH(
+            boost::shared_ptr<Quote>(new SimpleQuote(underlying)));
+        Handle<YieldTermStructure> flatTermStructure(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(settlementDate, riskFreeRate, dayCounter)));
+        Handle<YieldTermStructure> flatDividendTS(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(settlementDate, dividendYield, dayCounter)));
+        Handle<BlackVolTermStructure> flatVolTS(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(settlementDate, calendar,
+                                     volatility, dayCounter)));
+        boost::shared_ptr<BlackScholesMertonProcess> bsmProcess(
+            new BlackScholesMertonProcess(underlyingH, flatDividendTS,
+                                          flatTermStructure, flatVolTS));
+
+        boost::shared_ptr<StrikedTypePayoff> payoff(
+            new PlainVanillaPayoff(type, strike));
+        boost::shared_ptr<Exercise> europeanExercise(
+            new EuropeanExercise(maturity));
+        VanillaOption europeanOption(payoff, europeanExercise);
+
+        europeanOption.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(bsmProcess)));
+        std::cout << "Black-Scholes price: " << europeanOption.NPV()
+                  << std::endl << std::endl;
+
+        Size timeSteps = 252;
+        Size samples = 100000;
+        BigNatural seed = 42;
+
+        std::cout << std::setw(widths[0]) << std::left << "Method"
+                  << std::setw(widths[1]) << std::left << "Price"
+                  << std::setw(widths[2]) << std::left << "Error"
+                  << std::setw(widths[3]) << std::left << "Time (s)"
+                  << std::setw(widths[4]) << std::left << "Samples/s"
+                  << std::endl;
+
+        report("Scalar paths", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed),
+               samples);
+
+        report("Scalar paths, constant process", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withConstantParameters(),
+               samples);
+
+        // same samples, with virtual and with inlined calls
+        report("Blocks, virtual calls", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withConstantParameters()
+               .withThreads(1),
+               samples);
+
+        report("Blocks, specialized process/payoff", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withConstantParameters()
+               .withThreads(1)
+               .specializedEngine<ConstantBlackScholesProcess,
+                                  StaticPutPayoff_2>(),
+               samples);
+
+        // same samples again, with draws generated on another thread
+        report("Blocks, specialized, draw pipeline", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withConstantParameters()
+               .withThreads(1)
+               .withDrawPipeline()
+               .specializedEngine<ConstantBlackScholesProcess,
+                                  StaticPutPayoff_2>(),
+               samples);
+
+        Size batchSizes[] = { 64, 256 };
+        for (Size i=0; i<2; ++i) {
+            std::ostringstream method;
+            method << "Batched paths (" << batchSizes[i] << ")";
+            report(method.str(), europeanOption,
+                   MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                   .withSteps(timeSteps)
+                   .withSamples(samples)
+                   .withSeed(seed)
+                   .withConstantParameters()
+                   .withPathBatches(batchSizes[i]),
+                   samples);
+            method << ", float";
+            report(method.str(), europeanOption,
+                   MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                   .withSteps(timeSteps)
+                   .withSamples(samples)
+                   .withSeed(seed)
+                   .withConstantParameters()
+                   .withPathBatches(batchSizes[i])
+                   .withSinglePrecision(),
+                   samples);
+        }
+
+        report("Terminal sampling", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withTerminalSampling(),
+               samples);
+
+        // about a tenth of the samples, in whole blocks for each of
+        // the ten replicas
+        Size tenth = 10*detail::mcSamplesPerBlock;
+        report("Stratified terminal, 1/10", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(tenth)
+               .withReplicas(10)
+               .withSeed(seed)
+               .withTerminalSampling()
+               .withSampling(EuropeanSampling_2::Stratified));
+
+        report("Moment-matched terminal, 1/10", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(tenth)
+               .withReplicas(10)
+               .withSeed(seed)
+               .withTerminalSampling()
+               .withMomentMatching());
+
+        report("Latin hypercube paths, 1/10", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(tenth)
+               .withReplicas(10)
+               .withSeed(seed)
+               .withBrownianBridge()
+               .withSampling(EuropeanSampling_2::LatinHypercube));
+
+        report("Control variate", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withControlVariate(
+                          EuropeanControlVariate_2::DiscountedUnderlying),
+               samples);
+
+        report("Streaming statistics", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom,StreamingStatistics>(
+                                                                 bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withThreads(1),
+               samples);
+
+        report("Counter-based RNG, 4 threads", europeanOption,
+               MakeMCEuropeanEngine_2<CounterBased>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withThreads(4),
+               samples);
+
+        report("Bulk Gaussian transform", europeanOption,
+               MakeMCEuropeanEngine_2<BulkPseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withThreads(1),
+               samples);
+
+        // whole blocks for each of the default replicas
+        report("Randomized QMC", europeanOption,
+               MakeMCEuropeanEngine_2<RandomizedLowDiscrepancy>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(6*detail::mcDefaultReplicas*
+                            detail::mcSamplesPerBlock)
+               .withSeed(seed));
+
+        // a maximum number of samples is rounded down to whole
+        // blocks for each replica, so that none of them is left short
+        {
+            Size unit = detail::mcDefaultReplicas*detail::mcSamplesPerBlock;
+            europeanOption.setPricingEngine(
+                MakeMCEuropeanEngine_2<RandomizedLowDiscrepancy>(bsmProcess)
+                .withSteps(timeSteps)
+                .withAbsoluteTolerance(1.0e-12)
+                .withMaxSamples(2*unit + unit/2)
+                .withSeed(seed)
+                .withProgressCallback(
+                    [](const MonteCarloProgress_2&) { return true; }));
+            Real npv = europeanOption.NPV();
+            Size used = europeanOption.result<Size>("samples");
+            QL_REQUIRE(used == 2*unit && npv == npv,
+                       used << " samples used instead of " << 2*unit
+                       << ", price " << npv);
+        }
+
+        {
+            europeanOption.setPricingEngine(
+                MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(timeSteps)
+                .withSeed(seed)
+                .withConstantParameters()
+                .withTimeBudget(std::chrono::milliseconds(20)));
+            std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            Real npv = europeanOption.NPV();
+            double seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+            Size used = europeanOption.result<Size>("samples");
+            std::cout << std::setw(widths[0]) << std::left
+                      << "20 ms budget"
+                      << std::fixed << std::setprecision(6)
+                      << std::setw(widths[1]) << std::left << npv
+                      << std::setw(widths[2]) << std::left
+                      << europeanOption.errorEstimate()
+                      << std::setw(widths[3]) << std::left << seconds
+                      << std::setprecision(0)
+                      << std::setw(widths[4]) << std::left << used/seconds
+                      << std::endl;
+        }
+
+        // the simulation of a block allocates nothing: the
+        // generators of the workspaces are reseeded in place, as is
+        // the shuffler of stratified sampling, and the producers of
+        // the draw pipeline reuse the generators of their workspaces
+        {
+            EuropeanSampling_2::Type sampling[] = {
+                EuropeanSampling_2::Independent,
+                EuropeanSampling_2::LatinHypercube,
+                EuropeanSampling_2::Independent };
+            bool pipeline[] = { false, false, true };
+            std::cout << std::endl;
+            for (Size i=0; i<3; ++i) {
+                europeanOption.setPricingEngine(
+                    MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                    .withSteps(12)
+                    .withSamples(64*detail::mcSamplesPerBlock)
+                    .withSeed(seed)
+                    .withThreads(2)
+                    .withSampling(sampling[i])
+                    .withDrawPipeline(pipeline[i]));
+                europeanOption.NPV();
+                Size allocations =
+                    europeanOption.result<Size>("sampleLoopAllocations");
+                QL_REQUIRE(allocations == 0,
+                           allocations << " heap allocations in the "
+                           "sample loop of run " << i);
+            }
+            std::cout << "No heap allocations in the sample loop"
+                      << std::endl;
+        }
+
+        // samples are reduced in block order, so that a run in
+        // batches of 16 blocks on one thread gives the same results
+        // as a single batch of 64 blocks on eight threads
+        {
+            Size threads[] = { 1, 8 };
+            Real npv[2];
+            for (Size i=0; i<2; ++i) {
+                europeanOption.setPricingEngine(
+                    MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                    .withSteps(12)
+                    .withSamples(64*detail::mcSamplesPerBlock)
+                    .withSeed(seed)
+                    .withThreads(threads[i]));
+                npv[i] = europeanOption.NPV();
+            }
+            QL_REQUIRE(npv[0] == npv[1],
+                       "batched run gives " << npv[0]
+                       << " instead of " << npv[1]);
+        }
+
+        // bulk inverse cumulative normal against the scalar one
+        {
+            Size n = 10000000;
+            std::vector<Real> u(n), z(n), zScalar(n);
+            PhiloxUniformRsg uniforms(1, seed);
+            uniforms.fill(0, n, &u[0], n);
+
+            std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            bulkInverseCumulativeNormal(&u[0], &z[0], n);
+            double bulkSeconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+
+            InverseCumulativeNormal icn;
+            start = std::chrono::steady_clock::now();
+            for (Size i=0; i<n; ++i)
+                zScalar[i] = icn(u[i]);
+            double scalarSeconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+
+            // the random uniforms don't reach the far tails, which
+            // take a different branch: add powers of ten down to the
+            // smallest doubles, their complements, and the uniforms
+            // around the ends of the central region
+            std::vector<Real> edges;
+            for (int k=1; k<=307; ++k) {
+                edges.push_back(std::pow(10.0, -k));
+                if (k <= 16)
+                    edges.push_back(1.0 - std::pow(10.0, -k));
+            }
+            edges.push_back(std::numeric_limits<Real>::min());
+            edges.push_back(std::numeric_limits<Real>::denorm_min());
+            const Real bounds[] = { detail::icnLow, detail::icnHigh };
+            for (Size k=0; k<2; ++k) {
+                edges.push_back(std::nextafter(bounds[k], 0.0));
+                edges.push_back(bounds[k]);
+                edges.push_back(std::nextafter(bounds[k], 1.0));
+            }
+            u.insert(u.end(), edges.begin(), edges.end());
+            z.resize(u.size());
+            zScalar.resize(u.size());
+            bulkInverseCumulativeNormal(&u[n], &z[n], edges.size());
+            for (Size i=n; i<u.size(); ++i)
+                zScalar[i] = icn(u[i]);
+
+            // see bulkInverseCumulativeNormal; relative to the
+            // variate beyond one standard deviation
+            const Real tolerance = 1.0e-12;
+            Real maxError = 0.0;
+            for (Size i=0; i<u.size(); ++i)
+                maxError = std::max(maxError,
+                                    std::fabs(z[i]-zScalar[i])
+                                    / std::max<Real>(1.0,
+                                                     std::fabs(zScalar[i])));
+            QL_REQUIRE(maxError <= tolerance,
+                       "bulk Gaussian variates differ from "
+                       "InverseCumulativeNormal by " << maxError
+                       << " (relative), above " << tolerance);
+            std::cout << std::endl << "Gaussian variates (" << n << ")"
+                      << std::endl
+                      << std::scientific << std::setprecision(2)
+                      << "max difference from InverseCumulativeNormal: "
+                      << maxError << " (bound " << tolerance << ")"
+                      << std::endl
+                      << std::fixed << std::setprecision(0)
+                      << "bulk:   " << n/bulkSeconds << " variates/s"
+                      << std::endl
+                      << "scalar: " << n/scalarSeconds << " variates/s"
+                      << std::endl;
+        }
+
+        // Greeks from the same paths as the value
+        europeanOption.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(bsmProcess)));
+        Real analyticGreeks[] = { europeanOption.delta(),
+                                  europeanOption.gamma(),
+                                  europeanOption.vega() };
+        europeanOption.setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+            .withSteps(timeSteps)
+            .withSamples(samples)
+            .withSeed(seed)
+            .withGreeks());
+        Real mcGreeks[] = { europeanOption.delta(),
+                            europeanOption.gamma(),
+                            europeanOption.vega() };
+        std::string greekNames[] = { "delta", "gamma", "vega" };
+        std::cout << std::endl << "Greeks (analytic, MC, error)"
+                  << std::endl;
+        for (Size i=0; i<3; ++i)
+            std::cout << std::setw(widths[0]) << std::left << greekNames[i]
+                      << std::fixed << std::setprecision(6)
+                      << std::setw(widths[1]) << std::left
+                      << analyticGreeks[i]
+                      << std::setw(widths[2]) << std::left << mcGreeks[i]
+                      << std::setw(widths[3]) << std::left
+                      << europeanOption.result<Real>(greekNames[i] +
+                                                     "ErrorEstimate")
+                      << std::endl;
+
+        // several payoffs on the same paths
+        std::vector<std::string> names;
+        std::vector<boost::shared_ptr<PathPayoff_2> > payoffs;
+        Real strikes[] = { 32.0, 36.0, 40.0, 44.0 };
+        for (Size i=0; i<4; ++i) {
+            std::ostringstream name;
+            name << "Put " << strikes[i];
+            names.push_back(name.str());
+            payoffs.push_back(boost::shared_ptr<PathPayoff_2>(
+                       new EuropeanPathPayoff_2(Option::Put, strikes[i])));
+        }
+        names.push_back("Asian put");
+        payoffs.push_back(boost::shared_ptr<PathPayoff_2>(
+            new AsianPathPayoff_2(Average::Arithmetic, Option::Put, strike)));
+        names.push_back("Down-and-out put");
+        payoffs.push_back(boost::shared_ptr<PathPayoff_2>(
+            new BarrierPathPayoff_2(Barrier::DownOut, 30.0, 0.0,
+                                    Option::Put, strike)));
+        names.push_back("Lookback put");
+        payoffs.push_back(boost::shared_ptr<PathPayoff_2>(
+                                  new LookbackPathPayoff_2(Option::Put)));
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        MCMultiPayoffSimulation_2<PseudoRandom> simulation(
+            bsmProcess, payoffs,
+            bsmProcess->time(maturity), timeSteps, false, false, seed);
+        simulation.addSamples(samples);
+        double seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::endl << payoffs.size()
+                  << " payoffs on the same paths (" << std::setprecision(3)
+                  << seconds << " s)" << std::endl;
+        Array values = simulation.values();
+        Array errors = simulation.errorEstimates();
+        for (Size i=0; i<payoffs.size(); ++i)
+            std::cout << std::setw(widths[0]) << std::left << names[i]
+                      << std::fixed << std::setprecision(6)
+                      << std::setw(widths[1]) << std::left << values[i]
+                      << std::setw(widths[2]) << std::left << errors[i]
+                      << std::endl;
+
+        // multilevel Monte Carlo on the Asian put; finer levels
+        // converge to continuous averaging
+        Real rmse = 0.005;
+        MultilevelMonteCarlo_2<PseudoRandom> mlmc(
+            bsmProcess, payoffs[4], bsmProcess->time(maturity),
+            flatTermStructure->discount(maturity), 1, seed);
+        start = std::chrono::steady_clock::now();
+        mlmc.simulate(rmse);
+        seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        std::cout << std::endl << "Multilevel Asian put, RMSE " << rmse
+                  << std::fixed << std::setprecision(6) << ": "
+                  << mlmc.value() << " +/- " << mlmc.errorEstimate()
+                  << std::setprecision(3) << " (" << seconds << " s)"
+                  << std::endl
+                  << std::setw(widths[0]) << std::left << "Level (steps)"
+                  << std::setw(widths[1]) << std::left << "Samples"
+                  << std::setw(widths[2]) << std::left << "Variance"
+                  << std::setw(widths[3]) << std::left << "Cost"
+                  << std::setw(widths[4]) << std::left << "Time (s)"
+                  << std::endl;
+        Real totalCost = 0.0;
+        for (Size l=0; l<mlmc.levels(); ++l) {
+            std::ostringstream level;
+            level << l << " (" << mlmc.timeSteps(l) << ")";
+            std::cout << std::setw(widths[0]) << std::left << level.str()
+                      << std::setw(widths[1]) << std::left
+                      << mlmc.samples(l)
+                      << std::scientific << std::setprecision(3)
+                      << std::setw(widths[2]) << std::left
+                      << mlmc.variance(l)
+                      << std::setw(widths[3]) << std::left << mlmc.cost(l)
+                      << std::fixed
+                      << std::setw(widths[4]) << std::left << mlmc.time(l)
+                      << std::endl;
+            totalCost += mlmc.cost(l);
+        }
+        std::cout << std::scientific << std::setprecision(3)
+                  << "total cost " << totalCost
+                  << ", single-level cost " << mlmc.singleLevelCost(rmse)
+                  << std::fixed << std::endl;
+
+        // the European option needs no finer levels under exact
+        // log-normal steps
+        europeanOption.setPricingEngine(
+            MakeMLMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+            .withAbsoluteTolerance(rmse)
+            .withSeed(seed));
+        Real mlmcValue = europeanOption.NPV();
+        Size mlmcLevels = europeanOption.result<Size>("levels");
+        QL_REQUIRE(mlmcLevels == 1,
+                   mlmcLevels << " levels used with exact steps");
+        std::cout << std::setw(widths[0]) << std::left
+                  << "Multilevel European, 1 level"
+                  << std::setprecision(6) << mlmcValue << " +/- "
+                  << europeanOption.errorEstimate() << std::endl;
+
+        // least-squares Monte Carlo against a binomial tree
+        boost::shared_ptr<Exercise> americanExercise(
+            new AmericanExercise(settlementDate, maturity));
+        VanillaOption americanOption(payoff, americanExercise);
+        americanOption.setPricingEngine(boost::shared_ptr<PricingEngine>(
+            new BinomialVanillaEngine<CoxRossRubinstein>(bsmProcess, 801)));
+        std::cout << std::endl << "American put, binomial tree: "
+                  << std::setprecision(6) << americanOption.NPV()
+                  << std::endl;
+        Size threads[] = { 1, 4 };
+        for (Size i=0; i<2; ++i) {
+            std::ostringstream method;
+            method << "Least-squares MC, " << threads[i] << " thread"
+                   << (threads[i] > 1 ? "s" : "");
+            report(method.str(), americanOption,
+                   MakeMCAmericanEngine_2<PseudoRandom>(bsmProcess)
+                   .withSteps(50)
+                   .withSamples(samples)
+                   .withCalibrationSamples(samples)
+                   .withSeed(seed)
+                   .withThreads(threads[i]),
+                   2*samples);
+        }
+
+        // importance sampling on a deep out-of-the-money put
+        Real deepStrike = 24.0;
+        VanillaOption deepOption(
+            boost::shared_ptr<StrikedTypePayoff>(
+                new PlainVanillaPayoff(Option::Put, deepStrike)),
+            europeanExercise);
+        deepOption.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                     new AnalyticEuropeanEngine(bsmProcess)));
+        std::cout << std::endl << "Put " << deepStrike
+                  << ", Black-Scholes price: " << std::scientific
+                  << std::setprecision(6) << deepOption.NPV()
+                  << std::fixed << std::endl;
+        report("Terminal sampling", deepOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withTerminalSampling(),
+               samples);
+        report("Terminal, importance sampling", deepOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withTerminalSampling()
+               .withImportanceSampling(),
+               samples);
+        std::cout << "shift " << std::setprecision(3)
+                  << deepOption.result<Real>("importanceShift")
+                  << ", variance reduction "
+                  << deepOption.result<Real>("varianceReductionFactor")
+                  << std::endl;
+        report("Paths, importance sampling", deepOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples/10)
+               .withSeed(seed)
+               .withImportanceSampling(),
+               samples/10);
+
+        // spot scenarios priced on common random numbers, generated
+        // once for all of them
+        boost::shared_ptr<McDrawStore> drawStore(new McDrawStore(
+            1, detail::mcSamplesPerBlock,
+            (samples + detail::mcSamplesPerBlock - 1)
+                                            / detail::mcSamplesPerBlock));
+        start = std::chrono::steady_clock::now();
+        fillMcDrawStore<PseudoRandom>(*drawStore, seed);
+        seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        std::cout << std::endl << "Spot scenarios on a draw store ("
+                  << std::setprecision(3) << seconds << " s to fill)"
+                  << std::endl
+                  << std::setw(widths[0]) << std::left << "Spot"
+                  << std::setw(widths[1]) << std::left << "P&L"
+                  << std::setw(widths[2]) << std::left << "Analytic"
+                  << std::setw(widths[3]) << std::left << "Time (s)"
+                  << std::endl;
+        Real baseValue = 0.0, baseAnalytic = 0.0;
+        Real spots[] = { 36.0, 34.0, 35.0, 37.0, 38.0 };
+        for (Size i=0; i<5; ++i) {
+            boost::shared_ptr<BlackScholesMertonProcess> scenario(
+                new BlackScholesMertonProcess(
+                    Handle<Quote>(boost::shared_ptr<Quote>(
+                                                new SimpleQuote(spots[i]))),
+                    flatDividendTS, flatTermStructure, flatVolTS));
+            europeanOption.setPricingEngine(
+                boost::shared_ptr<PricingEngine>(
+                    new AnalyticEuropeanEngine(scenario)));
+            Real analytic = europeanOption.NPV();
+            europeanOption.setPricingEngine(
+                MakeMCEuropeanEngine_2<PseudoRandom>(scenario)
+                .withSteps(timeSteps)
+                .withSamples(samples)
+                .withTerminalSampling()
+                .withDrawStore(drawStore));
+            start = std::chrono::steady_clock::now();
+            Real value = europeanOption.NPV();
+            seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+            if (i == 0) {
+                baseValue = value;
+                baseAnalytic = analytic;
+                continue;
+            }
+            std::cout << std::setw(widths[0]) << std::left << spots[i]
+                      << std::fixed << std::setprecision(6)
+                      << std::setw(widths[1]) << std::left
+                      << value - baseValue
+                      << std::setw(widths[2]) << std::left
+                      << analytic - baseAnalytic
+                      << std::setw(widths[3]) << std::left << seconds
+                      << std::endl;
+        }
+
+        // the same run in one shard and split in four, merged from
+        // the files written by each shard
+        europeanOption.setPricingEngine(
+            MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+            .withSteps(timeSteps)
+            .withSamples(samples)
+            .withSeed(seed)
+            .withShard(0, 1));
+        McShardResult single =
+            europeanOption.result<McShardResult>("shardResult");
+        Size shards = 4;
+        start = std::chrono::steady_clock::now();
+        runShards(shards, [&](Size k) {
+            europeanOption.setPricingEngine(
+                MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                .withSteps(timeSteps)
+                .withSamples(samples)
+                .withSeed(seed)
+                .withShard(k, shards));
+            std::ostringstream fileName;
+            fileName << "shard" << k << ".txt";
+            europeanOption.result<McShardResult>("shardResult")
+                .save(fileName.str());
+        });
+        McShardResult merged;
+        for (Size k=0; k<shards; ++k) {
+            std::ostringstream fileName;
+            fileName << "shard" << k << ".txt";
+            merged.merge(McShardResult::load(fileName.str()));
+        }
+        QL_REQUIRE(merged.seed() == single.seed() &&
+                   merged.totalSamples() == single.totalSamples() &&
+                   merged.dimension() == single.dimension(),
+                   "merged shards describe another run");
+        seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        std::cout << std::endl << shards << " shards (" << std::setprecision(3)
+                  << seconds << " s)" << std::endl
+                  << std::setprecision(17)
+                  << std::setw(widths[0]) << std::left << "Single shard"
+                  << single.mean() << " +/- " << single.errorEstimate()
+                  << std::endl
+                  << std::setw(widths[0]) << std::left << "Merged shards"
+                  << merged.mean() << " +/- " << merged.errorEstimate()
+                  << std::endl;
+
+        // a run checkpointed after each batch, then cut short as if
+        // preempted in the middle of a write, and resumed; then cut
+        // again after the records written by the resumed run
+        std::string checkpoint = "checkpoint.bin";
+        std::remove(checkpoint.c_str());
+        boost::shared_ptr<PricingEngine> checkpointed =
+            MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+            .withSteps(timeSteps)
+            .withSamples(samples)
+            .withSeed(seed)
+            .withCheckpoint(checkpoint, 0.0);
+        europeanOption.setPricingEngine(checkpointed);
+        start = std::chrono::steady_clock::now();
+        Real uninterrupted = europeanOption.NPV();
+        seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        Real checkpointTime =
+            europeanOption.result<Real>("checkpointTime");
+        std::cout << std::endl << "Checkpointed run ("
+                  << std::setprecision(3) << checkpointTime << " s of "
+                  << seconds << " s spent saving)" << std::endl
+                  << std::setprecision(17)
+                  << std::setw(widths[0]) << std::left << "Uninterrupted"
+                  << uninterrupted << std::endl;
+        Real cuts[] = { 0.5, 0.75 };
+        for (Size i=0; i<2; ++i) {
+            cutFile(checkpoint, cuts[i]);
+            europeanOption.recalculate();
+            Real resumed = europeanOption.NPV();
+            Size runSamples = europeanOption.result<Size>("samples");
+            McCheckpointFile::Header header;
+            McShardResult saved;
+            McCheckpointFile(checkpoint).read(header, saved);
+            std::cout << std::setw(widths[0]) << std::left
+                      << (i == 0 ? "Resumed" : "Resumed again")
+                      << resumed << " (" << runSamples << " samples, "
+                      << saved.samples() << " saved)" << std::endl;
+            QL_REQUIRE(resumed == uninterrupted,
+                       "resumed run differs from uninterrupted one");
+            QL_REQUIRE(saved.samples() == runSamples,
+                       "checkpoint lost records written after resuming");
+        }
+
+        // without a seed, a resumed run continues the stream of the
+        // seed saved in the checkpoint, also with generators that
+        // are only moved from block to block
+        std::remove(checkpoint.c_str());
+        europeanOption.setPricingEngine(
+            MakeMCEuropeanEngine_2<CounterBased>(bsmProcess)
+            .withSteps(timeSteps)
+            .withSamples(samples)
+            .withThreads(2)
+            .withCheckpoint(checkpoint, 0.0));
+        Real randomSeeded = europeanOption.NPV();
+        cutFile(checkpoint, 0.5);
+        europeanOption.recalculate();
+        QL_REQUIRE(europeanOption.NPV() == randomSeeded,
+                   "resumed run ignores the seed of the checkpoint");
+        std::remove(checkpoint.c_str());
+
+        // term structures sampled once on the simulation grid instead
+        // of queried at each step; the paths are the same
+        std::vector<Date> curveDates(5);
+        std::vector<Rate> zeroRates(5);
+        Rate curveRates[] = { 0.03, 0.05, 0.06, 0.075, 0.05 };
+        for (Size i=0; i<5; ++i) {
+            curveDates[i] = settlementDate + Period(Integer(i),Years);
+            zeroRates[i] = curveRates[i];
+        }
+        Handle<YieldTermStructure> zeroCurve(
+            boost::shared_ptr<YieldTermStructure>(
+                new ZeroCurve(curveDates, zeroRates, dayCounter)));
+        std::vector<Date> volDates(3);
+        std::vector<Volatility> volatilities(3);
+        Volatility curveVols[] = { 0.18, 0.22, 0.34 };
+        for (Size i=0; i<3; ++i) {
+            volDates[i] = settlementDate + Period(Integer(4*(i+1)),Months);
+            volatilities[i] = curveVols[i];
+        }
+        Handle<BlackVolTermStructure> varianceCurve(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackVarianceCurve(settlementDate, volDates,
+                                       volatilities, dayCounter)));
+        boost::shared_ptr<BlackScholesMertonProcess> curveProcess(
+            new BlackScholesMertonProcess(underlyingH, flatDividendTS,
+                                          zeroCurve, varianceCurve));
+
+        europeanOption.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                               new AnalyticEuropeanEngine(curveProcess)));
+        std::cout << std::endl << "Term structures, Black-Scholes price: "
+                  << europeanOption.NPV() << std::endl;
+        report("Term structures, original process", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(curveProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withThreads(1),
+               samples);
+        report("Term structures, grid process", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(curveProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withThreads(1)
+               .withGridParameters(),
+               samples);
+        report("Term structures, grid, specialized", europeanOption,
+               MakeMCEuropeanEngine_2<PseudoRandom>(curveProcess)
+               .withSteps(timeSteps)
+               .withSamples(samples)
+               .withSeed(seed)
+               .withThreads(1)
+               .withGridParameters()
+               .specializedEngine<GridBlackScholesProcess,
+                                  StaticPutPayoff_2>(),
+               samples);
+
+        // a book of options valued within a time budget, with the
+        // samples going where they reduce its error most, and with
+        // the same samples shared evenly
+        MonteCarloPortfolio_2 book;
+        std::vector<boost::shared_ptr<VanillaOption> > bookOptions;
+        Real bookStrikes[] = { 24.0, 30.0, 36.0, 42.0, 48.0, 36.0 };
+        Option::Type bookTypes[] = { Option::Put, Option::Put, Option::Put,
+                                     Option::Call, Option::Call,
+                                     Option::Call };
+        Real quantities[] = { 100.0, 10.0, -5.0, 5.0, 50.0, 1.0 };
+        MonteCarloPortfolio_2::EngineFactory terminalEngine =
+            [&](Size n, BigNatural s) -> boost::shared_ptr<PricingEngine> {
+                return MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                       .withSteps(1)
+                       .withSamples(n)
+                       .withSeed(s)
+                       .withTerminalSampling();
+            };
+        for (Size i=0; i<6; ++i) {
+            bookOptions.push_back(boost::shared_ptr<VanillaOption>(
+                new VanillaOption(
+                    boost::shared_ptr<StrikedTypePayoff>(
+                        new PlainVanillaPayoff(bookTypes[i],
+                                               bookStrikes[i])),
+                    europeanExercise)));
+            book.add(bookOptions.back(), quantities[i], terminalEngine);
+        }
+        book.simulate(0.5, seed);
+        Size bookSamples = 0;
+        for (Size i=0; i<book.size(); ++i)
+            bookSamples += book.samples(i);
+        Size evenSamples = bookSamples/book.size();
+        Real evenVariance = 0.0;
+        std::cout << std::endl << "Book of " << book.size()
+                  << " options" << std::endl;
+        for (Size i=0; i<book.size(); ++i) {
+            bookOptions[i]->setPricingEngine(terminalEngine(evenSamples,
+                                                            seed));
+            Real evenError = quantities[i]*bookOptions[i]->errorEstimate();
+            evenVariance += evenError*evenError;
+            std::ostringstream position;
+            position << quantities[i] << " x "
+                     << (bookTypes[i] == Option::Put ? "put " : "call ")
+                     << bookStrikes[i];
+            std::cout << std::setw(widths[0]) << std::left << position.str()
+                      << std::fixed << std::setprecision(6)
+                      << std::setw(widths[1]) << std::left << book.value(i)
+                      << std::setw(widths[2]) << std::left
+                      << book.errorEstimate(i)
+                      << std::setw(widths[3]) << std::left
+                      << book.samples(i) << std::endl;
+        }
+        std::cout << std::setw(widths[0]) << std::left << "Book"
+                  << std::setw(widths[1]) << std::left << book.value()
+                  << std::setw(widths[2]) << std::left
+                  << book.errorEstimate()
+                  << std::setprecision(3) << book.time() << " s"
+                  << std::endl
+                  << std::setw(widths[0]) << std::left << "Book, even split"
+                  << std::setw(widths[1]) << std::left << ""
+                  << std::setprecision(6)
+                  << std::setw(widths[2]) << std::left
+                  << std::sqrt(evenVariance) << std::endl;
 
         return 0;
 
@@ -23,4 +983,3 @@ int main() {
         return 1;
     }
 }
-
@@ -0,0 +1,51 @@
+/*! \file mcallocationcounter.hpp
+    \brief Count of the heap allocations made by each thread
+*/
+
+#ifndef mc_allocation_counter_hpp
+#define mc_allocation_counter_hpp
+
+#include <ql/types.hpp>
+#include <atomic>
+
+namespace QuantLib {
+
+    //! Count of the heap allocations made by each thread
+    /*! The count is only kept by programs that replace the global
+        operator new and call add() from it; enabled() tells whether
+        one of them did.  Monte Carlo engines use it to report the
+        allocations made by their sample loop, which can thus be
+        checked not to allocate.
+    */
+    class McAllocationCounter {
+      public:
+        //! to be called by a replacement of operator new
+        static void add() {
+            ++threadCount();
+            std::atomic<bool>& flag = enabledFlag();
+            if (!flag.load(std::memory_order_relaxed))
+                flag.store(true, std::memory_order_relaxed);
+        }
+        //! whether allocations are counted
+        static bool enabled() {
+            return enabledFlag().load(std::memory_order_relaxed);
+        }
+        //! allocations counted so far on the calling thread
+        static Size thread() { return threadCount(); }
+      private:
+        // neither initialization allocates, so that add() can be
+        // called from operator new
+        static Size& threadCount() {
+            static thread_local Size count = 0;
+            return count;
+        }
+        static std::atomic<bool>& enabledFlag() {
+            static std::atomic<bool> flag(false);
+            return flag;
+        }
+    };
+
+}
+
+
+#endif
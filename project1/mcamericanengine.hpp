@@ -0,0 +1,578 @@
+/*! \file mcamericanengine.hpp
+    \brief Least-squares Monte Carlo engine for American and Bermudan options
+*/
+
+#ifndef mc_american_engine_hpp
+#define mc_american_engine_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/math/matrixutilities/svd.hpp>
+#include <ql/math/statistics/statistics.hpp>
+#include "mceuropeanengine.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace QuantLib {
+
+    //! American and Bermudan option engine using least-squares Monte Carlo
+    /*! \ingroup vanillaengines
+
+        The continuation value at each exercise time is estimated as
+        in Longstaff and Schwartz, by regressing the discounted cash
+        flows of in-the-money calibration paths on the polynomials in
+        \f$ S/K \f$ up to the given order.  The price is then
+        estimated on an independent set of paths, exercising when
+        the exercise value exceeds the estimated continuation value;
+        since the exercise policy is not optimal, the price is
+        biased low.  The in-sample estimate from the calibration
+        paths is returned as the "calibrationValue" additional
+        result.
+
+        Paths are generated in blocks of detail::mcSamplesPerBlock by
+        BatchPathGenerator, each block from its own random stream as
+        in MCEuropeanEngine_2; the pricing paths use the blocks
+        following the calibration ones.  Only the values at exercise
+        times are stored, in structure-of-arrays layout, so that the
+        values of a block at a given time are contiguous.  Since the
+        basis functions are monomials, the normal equations only need
+        the power sums \f$ \sum_j x_j^k \f$ and \f$ \sum_j y_j x_j^k \f$,
+        which are accumulated block by block in a single sweep over
+        the contiguous values; the small system is then solved by
+        SVD.  Path generation, the accumulation of the sums and the
+        application of the exercise decisions are shared among the
+        given number of threads, in a single pass over the blocks per
+        exercise time; per-block results are combined in block
+        order, so that the price does not depend on it.
+
+        \pre the process must be a Black-Scholes process with
+             strike-independent volatility, whose log-normal steps
+             are exact.
+
+        \note the exercise times of an American option are the points
+              of the time grid after the earliest exercise date; a
+              Bermudan option is exercised on its dates, which are
+              added to the grid.
+    */
+    template <class RNG = PseudoRandom, class S = Statistics>
+    class MCAmericanEngine_2 : public VanillaOption::engine {
+      public:
+        MCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool brownianBridge,
+             Size requiredSamples,
+             Size calibrationSamples,
+             BigNatural seed,
+             Size polynomialOrder = 3,
+             Size nThreads = Null<Size>());
+        void calculate() const;
+      private:
+        struct Workspace : private boost::noncopyable {
+            McArena arena;
+            boost::shared_ptr<BatchPathGenerator<Real> > paths;
+            Real *values, *weights;
+            bool* exercised;
+            // restarted at each block
+            boost::optional<
+                typename detail::McBlockSequence<RNG>::rsg_type> generator;
+        };
+        void setupExercise() const;
+        // simulates the given block and stores its values at the
+        // exercise times, in structure-of-arrays layout
+        void simulateBlock(Workspace& workspace, Size block,
+                           Size paths, Real* values, Real* weights) const;
+        void calibrate() const;
+        void price() const;
+        Real exerciseValue(Real underlying) const {
+            return std::max<Real>(sign_*(underlying - strike_), 0.0);
+        }
+        Real continuationValue(Size exercise, Real underlying) const;
+        Size blockPaths(Size block, Size samples) const;
+        void forEachBlock(Size blocks,
+                          const std::function<void(Size,Size)>& f) const;
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size timeSteps_, timeStepsPerYear_;
+        bool brownianBridge_;
+        Size requiredSamples_, calibrationSamples_;
+        BigNatural seed_;
+        Size polynomialOrder_, nThreads_;
+        mutable BigNatural blockSeed_;
+        mutable TimeGrid grid_;
+        mutable Real strike_, sign_;
+        mutable std::vector<Size> exerciseIndices_;
+        mutable std::vector<DiscountFactor> discounts_;
+        mutable std::vector<Array> coefficients_;
+        mutable std::vector<boost::shared_ptr<Workspace> > workspaces_;
+        mutable std::vector<Real> calibrationValues_, cashFlows_;
+        mutable S statistics_;
+    };
+
+
+    //! Least-squares Monte Carlo American engine factory
+    template <class RNG = PseudoRandom, class S = Statistics>
+    class MakeMCAmericanEngine_2 {
+      public:
+        MakeMCAmericanEngine_2(
+                    const boost::shared_ptr<GeneralizedBlackScholesProcess>&);
+        // named parameters
+        MakeMCAmericanEngine_2& withSteps(Size steps);
+        MakeMCAmericanEngine_2& withStepsPerYear(Size steps);
+        MakeMCAmericanEngine_2& withBrownianBridge(bool b = true);
+        MakeMCAmericanEngine_2& withSamples(Size samples);
+        MakeMCAmericanEngine_2& withCalibrationSamples(Size samples);
+        MakeMCAmericanEngine_2& withSeed(BigNatural seed);
+        MakeMCAmericanEngine_2& withPolynomialOrder(Size order);
+        MakeMCAmericanEngine_2& withThreads(Size n);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size steps_, stepsPerYear_;
+        bool brownianBridge_;
+        Size samples_, calibrationSamples_;
+        BigNatural seed_;
+        Size polynomialOrder_, nThreads_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG, class S>
+    inline MCAmericanEngine_2<RNG,S>::MCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool brownianBridge,
+             Size requiredSamples,
+             Size calibrationSamples,
+             BigNatural seed,
+             Size polynomialOrder,
+             Size nThreads)
+    : process_(process), timeSteps_(timeSteps),
+      timeStepsPerYear_(timeStepsPerYear), brownianBridge_(brownianBridge),
+      requiredSamples_(requiredSamples),
+      calibrationSamples_(calibrationSamples), seed_(seed),
+      polynomialOrder_(polynomialOrder), nThreads_(nThreads) {
+        QL_REQUIRE(timeSteps != Null<Size>() ||
+                   timeStepsPerYear != Null<Size>(),
+                   "no time steps provided");
+        QL_REQUIRE(timeSteps == Null<Size>() ||
+                   timeStepsPerYear == Null<Size>(),
+                   "both time steps and time steps per year were provided");
+        QL_REQUIRE(timeSteps != 0,
+                   "timeSteps must be positive, " << timeSteps
+                   << " not allowed");
+        QL_REQUIRE(timeStepsPerYear != 0,
+                   "timeStepsPerYear must be positive, "
+                   << timeStepsPerYear << " not allowed");
+        QL_REQUIRE(requiredSamples > 0, "no samples required");
+        QL_REQUIRE(calibrationSamples > 0, "no calibration samples required");
+        QL_REQUIRE(polynomialOrder > 0 && polynomialOrder <= 8,
+                   "polynomial order (" << polynomialOrder
+                   << ") out of range [1, 8]");
+        QL_REQUIRE(nThreads == Null<Size>() || nThreads > 0,
+                   "at least one thread required");
+        QL_REQUIRE(!detail::McBlockSequence<RNG>::replicated,
+                   "randomized quasi-random policies not supported");
+        registerWith(process_);
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::calculate() const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        QL_REQUIRE(payoff->strike() > 0.0, "positive strike required");
+        QL_REQUIRE(detail::hasExactLogNormalTransition(process_),
+                   "a log-normal process with strike-independent "
+                   "volatility is required");
+        strike_ = payoff->strike();
+        sign_ = (payoff->optionType() == Option::Call ? 1.0 : -1.0);
+        blockSeed_ = (seed_ != 0 ? seed_ : SeedGenerator::instance().get());
+
+        setupExercise();
+
+        Size nThreads = (nThreads_ != Null<Size>() ? nThreads_ : 1);
+        workspaces_.resize(nThreads);
+        const Size B = detail::mcSamplesPerBlock;
+        for (Size i=0; i<nThreads; ++i) {
+            boost::shared_ptr<Workspace> workspace(new Workspace);
+            workspace->paths = boost::shared_ptr<BatchPathGenerator<Real> >(
+                new BatchPathGenerator<Real>(process_, grid_,
+                                             brownianBridge_, B,
+                                             workspace->arena));
+            workspace->values =
+                workspace->arena.allocate<Real>(exerciseIndices_.size()*B);
+            workspace->weights = workspace->arena.allocate<Real>(B);
+            workspace->exercised = workspace->arena.allocate<bool>(B);
+            workspace->generator = detail::McBlockSequence<RNG>::make(
+                grid_.size()-1, blockSeed_, 0, 1);
+            workspaces_[i] = workspace;
+        }
+
+        calibrate();
+        price();
+
+        results_.value = statistics_.mean();
+        results_.errorEstimate = statistics_.errorEstimate();
+        Real calibrationValue = 0.0;
+        for (Size j=0; j<cashFlows_.size(); ++j)
+            calibrationValue += cashFlows_[j];
+        results_.additionalResults["calibrationValue"] =
+            calibrationValue/cashFlows_.size();
+        results_.additionalResults["exerciseTimes"] =
+            exerciseIndices_.size();
+
+        workspaces_.clear();
+        calibrationValues_.clear();
+        cashFlows_.clear();
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::setupExercise() const {
+        const Exercise& exercise = *arguments_.exercise;
+        Time maturity = process_->time(exercise.lastDate());
+        QL_REQUIRE(maturity > 0.0, "expired option");
+        Size steps = (timeSteps_ != Null<Size>() ? timeSteps_ :
+                      std::max<Size>(Size(timeStepsPerYear_*maturity), 1));
+
+        std::vector<Time> exerciseTimes;
+        if (exercise.type() == Exercise::American) {
+            grid_ = TimeGrid(maturity, steps);
+            Time earliest = process_->time(exercise.dates().front());
+            for (Size i=1; i<grid_.size(); ++i)
+                if (grid_[i] >= earliest)
+                    exerciseTimes.push_back(grid_[i]);
+        } else {
+            for (Size i=0; i<exercise.dates().size(); ++i) {
+                Time t = process_->time(exercise.date(i));
+                if (t > 0.0)
+                    exerciseTimes.push_back(t);
+            }
+            grid_ = TimeGrid(exerciseTimes.begin(), exerciseTimes.end(),
+                             steps);
+        }
+
+        exerciseIndices_.resize(exerciseTimes.size());
+        discounts_.resize(exerciseTimes.size());
+        for (Size e=0; e<exerciseTimes.size(); ++e) {
+            exerciseIndices_[e] = grid_.index(exerciseTimes[e]);
+            discounts_[e] = process_->riskFreeRate()->discount(
+                                                      exerciseTimes[e]);
+        }
+        coefficients_.assign(exerciseTimes.size(), Array());
+    }
+
+    template <class RNG, class S>
+    inline Size MCAmericanEngine_2<RNG,S>::blockPaths(Size block,
+                                                      Size samples) const {
+        return std::min(detail::mcSamplesPerBlock,
+                        samples - block*detail::mcSamplesPerBlock);
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::simulateBlock(
+                                                   Workspace& workspace,
+                                                   Size block,
+                                                   Size paths,
+                                                   Real* values,
+                                                   Real* weights) const {
+        detail::McBlockSequence<RNG>::restart(*workspace.generator,
+                                              blockSeed_, block, 1);
+        BatchPathGenerator<Real>& batch = *workspace.paths;
+        batch.next(*workspace.generator, paths);
+        Real x0 = process_->x0();
+        for (Size e=0; e<exerciseIndices_.size(); ++e) {
+            const Real* logValues = batch.logValues(exerciseIndices_[e]);
+            Real* v = values + e*detail::mcSamplesPerBlock;
+            for (Size j=0; j<paths; ++j)
+                v[j] = x0 * std::exp(logValues[j]);
+        }
+        for (Size j=0; j<paths; ++j)
+            weights[j] = batch.weight(j);
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::calibrate() const {
+        const Size B = detail::mcSamplesPerBlock;
+        const Size E = exerciseIndices_.size();
+        const Size samples = calibrationSamples_;
+        const Size blocks = (samples + B - 1) / B;
+        const Size order = polynomialOrder_;
+
+        // values at the exercise times; block b, time e, path j is at
+        // (b*E + e)*B + j.  Cash flows are discounted to today.
+        calibrationValues_.resize(blocks*E*B);
+        cashFlows_.resize(samples);
+
+        // power sums of each block: sum x^k for k in [0, 2*order]
+        // followed by sum y*x^k for k in [0, order]
+        const Size sums = 3*order + 2;
+        std::vector<Real> partial(blocks*sums);
+        auto accumulate = [&](Size e, Size b) {
+            Size n = blockPaths(b, samples);
+            const DiscountFactor discount = discounts_[e];
+            const Real* v = &calibrationValues_[(b*E + e)*B];
+            const Real* cash = &cashFlows_[b*B];
+            Real* s = &partial[b*sums];
+            std::fill(s, s+sums, 0.0);
+            for (Size j=0; j<n; ++j) {
+                if (exerciseValue(v[j]) <= 0.0)
+                    continue;
+                Real x = v[j]/strike_, y = cash[j]/discount;
+                Real p = 1.0;
+                for (Size k=0; k<=order; ++k) {
+                    s[k] += p;
+                    s[2*order+1+k] += y*p;
+                    p *= x;
+                }
+                for (Size k=order+1; k<=2*order; ++k) {
+                    s[k] += p;
+                    p *= x;
+                }
+            }
+        };
+        auto applyExercise = [&](Size e, Size b) {
+            Size n = blockPaths(b, samples);
+            const DiscountFactor discount = discounts_[e];
+            const Real* v = &calibrationValues_[(b*E + e)*B];
+            Real* cash = &cashFlows_[b*B];
+            for (Size j=0; j<n; ++j) {
+                Real exercise = exerciseValue(v[j]);
+                if (exercise > 0.0 &&
+                    exercise > continuationValue(e, v[j]))
+                    cash[j] = discount*exercise;
+            }
+        };
+
+        // each pass over the blocks does all the work available
+        // before the next regression: the exercise decisions at the
+        // time just regressed, then the power sums at the previous
+        // one, so that the threads are started once per time
+        forEachBlock(blocks, [&](Size b, Size thread) {
+            Size n = blockPaths(b, samples);
+            Real* values = &calibrationValues_[b*E*B];
+            Workspace& workspace = *workspaces_[thread];
+            simulateBlock(workspace, b, n, values, workspace.weights);
+            const Real* last = values + (E-1)*B;
+            for (Size j=0; j<n; ++j)
+                cashFlows_[b*B+j] = discounts_[E-1]*exerciseValue(last[j]);
+            if (E > 1)
+                accumulate(E-2, b);
+        });
+
+        for (Size e=E-1; e-- > 0; ) {
+            if (e+2 < E) {
+                forEachBlock(blocks, [&](Size b, Size) {
+                    applyExercise(e+1, b);
+                    accumulate(e, b);
+                });
+            }
+
+            std::vector<Real> total(sums, 0.0);
+            for (Size b=0; b<blocks; ++b)
+                for (Size k=0; k<sums; ++k)
+                    total[k] += partial[b*sums+k];
+            // too few paths in the money for a regression: the
+            // option is not exercised at this time
+            if (total[0] < Real(order+1)) {
+                coefficients_[e] = Array();
+                continue;
+            }
+            Matrix A(order+1, order+1);
+            Array rhs(order+1);
+            for (Size k=0; k<=order; ++k) {
+                for (Size l=0; l<=order; ++l)
+                    A[k][l] = total[k+l];
+                rhs[k] = total[2*order+1+k];
+            }
+            coefficients_[e] = SVD(A).solveFor(rhs);
+        }
+
+        // decisions at the first time, for the in-sample estimate
+        if (E > 1)
+            forEachBlock(blocks,
+                         [&](Size b, Size) { applyExercise(0, b); });
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::price() const {
+        const Size B = detail::mcSamplesPerBlock;
+        const Size E = exerciseIndices_.size();
+        const Size samples = requiredSamples_;
+        const Size blocks = (samples + B - 1) / B;
+        const Size firstBlock = (calibrationSamples_ + B - 1) / B;
+
+        std::vector<Real> cash(samples), weights(samples);
+        forEachBlock(blocks, [&](Size b, Size thread) {
+            Size n = blockPaths(b, samples);
+            Workspace& workspace = *workspaces_[thread];
+            const Real* values = workspace.values;
+            simulateBlock(workspace, firstBlock+b, n,
+                          workspace.values, &weights[b*B]);
+            Real* c = &cash[b*B];
+            bool* exercised = workspace.exercised;
+            std::fill(exercised, exercised+n, false);
+            // exercise times outer, so that values are read in order
+            for (Size e=0; e<E; ++e) {
+                const Real* v = &values[e*B];
+                bool last = (e == E-1);
+                for (Size j=0; j<n; ++j) {
+                    if (exercised[j])
+                        continue;
+                    Real exercise = exerciseValue(v[j]);
+                    if (last || (exercise > 0.0 &&
+                                 exercise > continuationValue(e, v[j]))) {
+                        c[j] = discounts_[e]*exercise;
+                        exercised[j] = true;
+                    }
+                }
+            }
+        });
+
+        statistics_.reset();
+        for (Size i=0; i<samples; ++i)
+            statistics_.add(cash[i], weights[i]);
+    }
+
+    template <class RNG, class S>
+    inline Real MCAmericanEngine_2<RNG,S>::continuationValue(
+                                                   Size exercise,
+                                                   Real underlying) const {
+        const Array& c = coefficients_[exercise];
+        if (c.empty())
+            return QL_MAX_REAL;
+        Real x = underlying/strike_, result = 0.0;
+        for (Size k=c.size(); k-- > 0; )
+            result = result*x + c[k];
+        return result;
+    }
+
+    template <class RNG, class S>
+    inline void MCAmericanEngine_2<RNG,S>::forEachBlock(
+                       Size blocks,
+                       const std::function<void(Size,Size)>& f) const {
+        std::atomic<Size> nextBlock(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto work = [&](Size thread) {
+            try {
+                for (Size b = nextBlock++; b < blocks; b = nextBlock++)
+                    f(b, thread);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                nextBlock = blocks;
+            }
+        };
+
+        Size nWorkers = std::min(workspaces_.size(), blocks);
+        std::vector<std::thread> workers;
+        for (Size i=1; i<nWorkers; ++i)
+            workers.push_back(std::thread(work, i));
+        work(0);
+        for (Size i=0; i<workers.size(); ++i)
+            workers[i].join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>::MakeMCAmericanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
+    : process_(process), steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
+      brownianBridge_(false), samples_(Null<Size>()),
+      calibrationSamples_(2048), seed_(0), polynomialOrder_(3),
+      nThreads_(Null<Size>()) {}
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withSteps(Size steps) {
+        steps_ = steps;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withStepsPerYear(Size steps) {
+        stepsPerYear_ = steps;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withBrownianBridge(bool b) {
+        brownianBridge_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withSamples(Size samples) {
+        samples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withCalibrationSamples(Size samples) {
+        calibrationSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withPolynomialOrder(Size order) {
+        polynomialOrder_ = order;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCAmericanEngine_2<RNG,S>&
+    MakeMCAmericanEngine_2<RNG,S>::withThreads(Size n) {
+        QL_REQUIRE(n > 0, "at least one thread required");
+        nThreads_ = n;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline
+    MakeMCAmericanEngine_2<RNG,S>::operator boost::shared_ptr<PricingEngine>()
+                                                                      const {
+        QL_REQUIRE(steps_ != Null<Size>() || stepsPerYear_ != Null<Size>(),
+                   "number of steps not given");
+        QL_REQUIRE(steps_ == Null<Size>() || stepsPerYear_ == Null<Size>(),
+                   "number of steps overspecified");
+        QL_REQUIRE(samples_ != Null<Size>(), "number of samples not given");
+        return boost::shared_ptr<PricingEngine>(new
+            MCAmericanEngine_2<RNG,S>(process_,
+                                      steps_,
+                                      stepsPerYear_,
+                                      brownianBridge_,
+                                      samples_,
+                                      calibrationSamples_,
+                                      seed_,
+                                      polynomialOrder_,
+                                      nThreads_));
+    }
+
+}
+
+
+#endif
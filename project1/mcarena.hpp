@@ -0,0 +1,86 @@
+
+/*! \file mcarena.hpp
+    \brief Arena allocator for Monte Carlo workspaces
+*/
+
+#ifndef mc_arena_hpp
+#define mc_arena_hpp
+
+#include <ql/errors.hpp>
+#include <ql/types.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Arena allocator for the buffers of a Monte Carlo sample loop
+    /*! Buffers are carved out of a few large chunks and are only
+        returned to the heap when the arena is destroyed; release()
+        makes the whole arena available again without freeing it.
+        Buffers are aligned on cache lines, which also satisfies the
+        alignment of AVX-512 registers.
+
+        The arena counts the chunks it requests from the heap, so that
+        callers can check that a loop running on buffers obtained
+        beforehand does not allocate.
+
+        \warning only trivial types should be allocated; no
+                 constructor or destructor is called.
+    */
+    class McArena : private boost::noncopyable {
+      public:
+        enum { alignment = 64 };
+        explicit McArena(Size chunkSize = 65536)
+        : current_(0), offset_(0), chunkSize_(chunkSize),
+          heapAllocations_(0) {}
+        ~McArena() {
+            for (Size i=0; i<chunks_.size(); ++i)
+                delete[] chunks_[i];
+        }
+        template <class T>
+        T* allocate(Size n) {
+            return static_cast<T*>(allocateBytes(n*sizeof(T)));
+        }
+        //! makes all the memory available again, keeping the chunks
+        void release() {
+            current_ = 0;
+            offset_ = 0;
+        }
+        //! number of chunks requested from the heap so far
+        Size heapAllocations() const { return heapAllocations_; }
+      private:
+        void* allocateBytes(Size bytes) {
+            while (current_ < chunks_.size()) {
+                Size start = alignedOffset(current_, offset_);
+                if (start + bytes <= sizes_[current_]) {
+                    offset_ = start + bytes;
+                    return chunks_[current_] + start;
+                }
+                ++current_;
+                offset_ = 0;
+            }
+            Size size = std::max(chunkSize_, bytes + Size(alignment));
+            chunks_.push_back(new char[size]);
+            sizes_.push_back(size);
+            ++heapAllocations_;
+            Size start = alignedOffset(current_, 0);
+            offset_ = start + bytes;
+            return chunks_[current_] + start;
+        }
+        Size alignedOffset(Size chunk, Size offset) const {
+            std::size_t address =
+                reinterpret_cast<std::size_t>(chunks_[chunk]) + offset;
+            std::size_t aligned =
+                (address + alignment - 1) & ~std::size_t(alignment - 1);
+            return offset + Size(aligned - address);
+        }
+        std::vector<char*> chunks_;
+        std::vector<Size> sizes_;
+        Size current_, offset_, chunkSize_, heapAllocations_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,229 @@
+/*! \file mccheckpoint.hpp
+    \brief Append-only binary checkpoints of Monte Carlo runs
+*/
+
+#ifndef mc_checkpoint_hpp
+#define mc_checkpoint_hpp
+
+#include "mcshardresult.hpp"
+#include <boost/cstdint.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace QuantLib {
+
+    //! Binary checkpoint of the blocks completed by a Monte Carlo run
+    /*! The file starts with a header describing the run and goes on
+        with one fixed-size record per completed block, in block
+        order; saving a checkpoint only appends the blocks completed
+        since the previous one, so that its cost doesn't grow with
+        the length of the run.  Since the random stream of each block
+        is determined by the seed and the block index, the number of
+        completed blocks is all that is needed to resume generation.
+
+        A record cut short by an interrupted write is ignored when
+        reading, as are any records after it; truncate() removes them
+        before a resumed run appends its own.  Files are meant to be
+        read on the machine that wrote them.
+    */
+    class McCheckpointFile {
+      public:
+        struct Header {
+            boost::uint64_t magic, seed, samples, dimension;
+            boost::uint64_t firstBlock, lastBlock, replicas, reserved;
+        };
+        explicit McCheckpointFile(const std::string& fileName)
+        : fileName_(fileName) {}
+        const std::string& fileName() const { return fileName_; }
+        //! returns a header for the given run
+        static Header header(BigNatural seed, Size samples,
+                             Size dimension, Size firstBlock,
+                             Size lastBlock, Size replicas) {
+            Header h = { magic, seed, samples, dimension,
+                         firstBlock, lastBlock, replicas, 0 };
+            return h;
+        }
+        /*! reads the header and the blocks saved so far; returns
+            false if the file doesn't exist or is empty */
+        bool read(Header& header, McShardResult& result) const {
+            std::ifstream in(fileName_.c_str(), std::ios_base::binary);
+            if (!in || in.peek() == std::ifstream::traits_type::eof())
+                return false;
+            in.read(reinterpret_cast<char*>(&header), sizeof(Header));
+            QL_REQUIRE(in && header.magic == magic,
+                       fileName_ << " is not a checkpoint");
+            result = McShardResult(Size(header.replicas),
+                                   BigNatural(header.seed),
+                                   Size(header.samples),
+                                   Size(header.dimension));
+            Record record;
+            Size expected = Size(header.firstBlock);
+            while (in.read(reinterpret_cast<char*>(&record),
+                           sizeof(Record))) {
+                // anything after a damaged record is discarded
+                if (record.index != expected || record.samples == 0)
+                    break;
+                McShardResult::Block block = {
+                    Size(record.index), Size(record.samples),
+                    record.weightSum, record.valueSum, record.squareSum
+                };
+                result.add(block);
+                ++expected;
+            }
+            return true;
+        }
+        /*! discards anything after the header and the given number
+            of records, such as a record cut short by an interrupted
+            write, so that new records can be appended after them */
+        void truncate(Size records) const {
+            std::streamoff size = sizeof(Header) + records*sizeof(Record);
+            std::string contents;
+            {
+                std::ifstream in(fileName_.c_str(), std::ios_base::binary);
+                in.seekg(0, std::ios_base::end);
+                QL_REQUIRE(in && in.tellg() >= size,
+                           fileName_ << " holds less than " << records
+                           << " records");
+                if (in.tellg() == size)
+                    return;
+                contents.resize(std::size_t(size));
+                in.seekg(0, std::ios_base::beg);
+                in.read(&contents[0], size);
+                QL_REQUIRE(in, "error reading " << fileName_);
+            }
+            // the saved records are not touched until the copy is
+            // complete
+            std::string copy = fileName_ + ".tmp";
+            {
+                std::ofstream out(copy.c_str(), std::ios_base::binary |
+                                                std::ios_base::trunc);
+                out.write(contents.data(), size);
+                out.flush();
+                QL_REQUIRE(out, "error writing " << copy);
+            }
+            if (std::rename(copy.c_str(), fileName_.c_str()) != 0) {
+                // some platforms don't replace an existing file
+                std::remove(fileName_.c_str());
+                QL_REQUIRE(std::rename(copy.c_str(), fileName_.c_str()) == 0,
+                           "cannot replace " << fileName_);
+            }
+        }
+        //! starts a new checkpoint, discarding any previous one
+        void create(const Header& header) const {
+            std::ofstream out(fileName_.c_str(),
+                              std::ios_base::binary | std::ios_base::trunc);
+            out.write(reinterpret_cast<const char*>(&header),
+                      sizeof(Header));
+            QL_REQUIRE(out, "error writing " << fileName_);
+        }
+        //! appends the given blocks, which must follow the saved ones
+        void append(const McShardResult::Block* blocks, Size n) const {
+            if (n == 0)
+                return;
+            std::ofstream out(fileName_.c_str(),
+                              std::ios_base::binary | std::ios_base::app);
+            for (Size i=0; i<n; ++i) {
+                Record record = {
+                    blocks[i].index, blocks[i].samples,
+                    blocks[i].weightSum, blocks[i].valueSum,
+                    blocks[i].squareSum
+                };
+                out.write(reinterpret_cast<const char*>(&record),
+                          sizeof(Record));
+            }
+            out.flush();
+            QL_REQUIRE(out, "error writing " << fileName_);
+        }
+      private:
+        struct Record {
+            boost::uint64_t index, samples;
+            Real weightSum, valueSum, squareSum;
+        };
+        static const boost::uint64_t magic = 0x4d4343484b505431ULL;
+        std::string fileName_;
+    };
+
+
+    //! Periodic checkpoints of a running Monte Carlo simulation
+    /*! resume() is called once, before the simulation starts, and
+        returns the blocks saved by an interrupted attempt at the
+        same run; save() is called after each batch of blocks and
+        appends the ones completed since the last save, if the given
+        interval has elapsed or the run is complete.
+    */
+    class McCheckpointWriter {
+      public:
+        //! the interval between saves is given in seconds
+        McCheckpointWriter(const std::string& fileName, Real interval)
+        : file_(fileName), interval_(interval), written_(0), time_(0.0) {
+            QL_REQUIRE(interval >= 0.0,
+                       "negative checkpoint interval given");
+        }
+        /*! returns the blocks saved for the run described by the
+            header, or none if the file doesn't exist, in which case
+            a new checkpoint is started.  If \c anySeed is true, the
+            saved seed is accepted and copied into the header. */
+        McShardResult resume(McCheckpointFile::Header& header,
+                             bool anySeed) {
+            McCheckpointFile::Header saved;
+            McShardResult resumed;
+            if (file_.read(saved, resumed)) {
+                if (anySeed)
+                    header.seed = saved.seed;
+                QL_REQUIRE(saved.seed == header.seed &&
+                           saved.samples == header.samples &&
+                           saved.dimension == header.dimension &&
+                           saved.firstBlock == header.firstBlock &&
+                           saved.lastBlock == header.lastBlock &&
+                           saved.replicas == header.replicas,
+                           file_.fileName() << " was written by another "
+                           "run");
+                // new records go right after the last complete one
+                file_.truncate(resumed.blocks().size());
+            } else {
+                file_.create(header);
+                resumed = McShardResult(Size(header.replicas),
+                                        BigNatural(header.seed),
+                                        Size(header.samples),
+                                        Size(header.dimension));
+            }
+            written_ = resumed.blocks().size();
+            lastSave_ = clock::now();
+            return resumed;
+        }
+        /*! appends the blocks of the result added since the last
+            save, if the interval has elapsed or if \c complete */
+        void save(const McShardResult& result, bool complete) {
+            clock::time_point now = clock::now();
+            if (!complete &&
+                std::chrono::duration<Real>(now-lastSave_).count()
+                                                            < interval_)
+                return;
+            const std::vector<McShardResult::Block>& blocks =
+                result.blocks();
+            QL_REQUIRE(blocks.size() >= written_,
+                       "blocks removed from a checkpointed run");
+            if (blocks.size() > written_)
+                file_.append(&blocks[0] + written_,
+                             blocks.size() - written_);
+            written_ = blocks.size();
+            lastSave_ = clock::now();
+            time_ += std::chrono::duration<Real>(lastSave_-now).count();
+        }
+        //! time spent saving, in seconds
+        Real time() const { return time_; }
+      private:
+        typedef std::chrono::steady_clock clock;
+        McCheckpointFile file_;
+        Real interval_;
+        Size written_;
+        clock::time_point lastSave_;
+        Real time_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,195 @@
+/*! \file mcdrawring.hpp
+    \brief Lock-free rings of Gaussian draw blocks and their producers
+*/
+
+#ifndef mc_draw_ring_hpp
+#define mc_draw_ring_hpp
+
+#include "mcarena.hpp"
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Single-producer, single-consumer ring of Gaussian draw blocks
+    /*! Each slot holds the draws and weights of a block of samples.
+        A producer thread fills the slots in order and a consumer
+        thread reads them in the same order; the two threads only
+        share the slot counters, which are updated with
+        release/acquire atomics and never with locks.  When the ring
+        is full the producer waits for the consumer to release a
+        slot, which bounds the draws generated ahead of pricing.
+
+        Waiting threads yield instead of sleeping, since slots are
+        expected to become available within the time taken by a
+        block.  Either side can cancel the ring, e.g. on errors;
+        waiting calls then return a null pointer.
+
+        Slot buffers are carved out of the given arena, which must
+        outlive the ring.
+    */
+    class McDrawRing : private boost::noncopyable {
+      public:
+        struct Slot {
+            Real* draws;
+            Real* weights;
+            Size block, samples;
+        };
+        McDrawRing(Size slots, Size samples, Size dimension,
+                   McArena& arena)
+        : slots_(arena.allocate<Slot>(slots)), size_(slots),
+          head_(0), tail_(0), cancelled_(false) {
+            QL_REQUIRE(slots > 0, "at least one slot required");
+            for (Size i=0; i<slots; ++i) {
+                slots_[i].draws = arena.allocate<Real>(samples*dimension);
+                slots_[i].weights = arena.allocate<Real>(samples);
+                slots_[i].block = slots_[i].samples = 0;
+            }
+        }
+        //! \name Producer interface
+        //@{
+        //! waits for a free slot; returns null if cancelled
+        Slot* acquire() {
+            Size head = head_.load(std::memory_order_relaxed);
+            while (head - tail_.load(std::memory_order_acquire) == size_) {
+                if (cancelled_.load(std::memory_order_relaxed))
+                    return 0;
+                std::this_thread::yield();
+            }
+            return slots_ + head % size_;
+        }
+        //! hands the slot returned by acquire() to the consumer
+        void publish() {
+            head_.store(head_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+        }
+        //@}
+        //! \name Consumer interface
+        //@{
+        //! waits for a filled slot; returns null if cancelled
+        const Slot* front() {
+            Size tail = tail_.load(std::memory_order_relaxed);
+            while (head_.load(std::memory_order_acquire) == tail) {
+                if (cancelled_.load(std::memory_order_relaxed))
+                    return 0;
+                std::this_thread::yield();
+            }
+            return slots_ + tail % size_;
+        }
+        //! gives the slot returned by front() back to the producer
+        void release() {
+            tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+        }
+        //@}
+        //! makes both sides stop waiting
+        void cancel() { cancelled_.store(true); }
+        //! empties the ring; neither side must be running
+        void reset() {
+            head_.store(0);
+            tail_.store(0);
+            cancelled_.store(false);
+        }
+      private:
+        Slot* slots_;
+        Size size_;
+        // written by different threads; kept on separate cache lines
+        alignas(64) std::atomic<Size> head_;
+        alignas(64) std::atomic<Size> tail_;
+        alignas(64) std::atomic<bool> cancelled_;
+    };
+
+
+    //! Producer threads generating draw blocks ahead of their consumers
+    /*! Each consumer owns a ring, filled by a producer thread of its
+        own.  When a batch of blocks is dealt to \f$ n \f$ consumers,
+        consumer \f$ i \f$ receives blocks \f$ i, i+n, i+2n, \dots \f$
+        in this order, so that the block read from a ring is known in
+        advance.
+
+        A consumer that fails must call cancel(), which makes all
+        threads stop waiting; a producer that fails does the same and
+        its exception is rethrown by join().  The rings and their
+        arenas are kept from one batch to the next.
+    */
+    class McDrawPipeline : private boost::noncopyable {
+      public:
+        //! fills the slot with the draws of the given block of a batch
+        typedef std::function<void(McDrawRing::Slot&, Size block)> Producer;
+        McDrawPipeline(Size consumers, Size slots, Size samples,
+                       Size dimension)
+        : arenas_(consumers), rings_(consumers) {
+            for (Size i=0; i<consumers; ++i) {
+                arenas_[i].reset(new McArena);
+                rings_[i].reset(new McDrawRing(slots, samples, dimension,
+                                               *arenas_[i]));
+            }
+        }
+        ~McDrawPipeline() {
+            cancel();
+            for (Size i=0; i<producers_.size(); ++i)
+                producers_[i].join();
+        }
+        //! starts the producers of a batch dealt to the given consumers
+        void start(Size consumers, Size blocks, const Producer& produce) {
+            QL_REQUIRE(producers_.empty(), "pipeline already started");
+            QL_REQUIRE(consumers <= rings_.size(),
+                       consumers << " consumers given for "
+                       << rings_.size() << " rings");
+            error_ = std::exception_ptr();
+            for (Size i=0; i<consumers; ++i) {
+                rings_[i]->reset();
+                producers_.push_back(std::thread(
+                    [this, i, consumers, blocks, produce]() {
+                        McDrawRing& ring = *rings_[i];
+                        try {
+                            for (Size b=i; b<blocks; b+=consumers) {
+                                McDrawRing::Slot* slot = ring.acquire();
+                                if (!slot)
+                                    break;
+                                produce(*slot, b);
+                                ring.publish();
+                            }
+                        } catch (...) {
+                            {
+                                std::lock_guard<std::mutex> lock(mutex_);
+                                if (!error_)
+                                    error_ = std::current_exception();
+                            }
+                            cancel();
+                        }
+                    }));
+            }
+        }
+        //! ring read by the given consumer
+        McDrawRing& ring(Size consumer) { return *rings_[consumer]; }
+        //! makes producers and consumers stop waiting
+        void cancel() {
+            for (Size i=0; i<rings_.size(); ++i)
+                rings_[i]->cancel();
+        }
+        //! waits for the producers; rethrows the error of a failed one
+        void join() {
+            for (Size i=0; i<producers_.size(); ++i)
+                producers_[i].join();
+            producers_.clear();
+            if (error_)
+                std::rethrow_exception(error_);
+        }
+      private:
+        std::vector<boost::shared_ptr<McArena> > arenas_;
+        std::vector<boost::shared_ptr<McDrawRing> > rings_;
+        std::vector<std::thread> producers_;
+        std::exception_ptr error_;
+        std::mutex mutex_;
+    };
+
+}
+
+
+#endif
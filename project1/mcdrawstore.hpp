@@ -0,0 +1,156 @@
+/*! \file mcdrawstore.hpp
+    \brief Gaussian draws stored once and shared by several simulations
+*/
+
+#ifndef mc_draw_store_hpp
+#define mc_draw_store_hpp
+
+#include "mcarena.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <fstream>
+#include <string>
+
+namespace QuantLib {
+
+    //! Store of Gaussian draws for common random numbers
+    /*! The store holds the draws and weights of a number of blocks of
+        samples, laid out block after block and, within a block,
+        sample after sample.  It can live in memory, where any number
+        of engines can share it, or in a memory-mapped file, which
+        other processes can open read-only; in both cases readers get
+        pointers into the store and nothing is copied.
+
+        Files start with a small header recording the layout, which
+        is checked when they are opened; they are meant to be read on
+        the machine that wrote them.
+
+        The store is filled through the mutable accessors, e.g., by
+        fillMcDrawStore() in mceuropeanengine.hpp; it must not be
+        modified while readers are running.
+    */
+    class McDrawStore : private boost::noncopyable {
+      public:
+        //! creates a store in memory
+        McDrawStore(Size dimension, Size samplesPerBlock, Size blocks)
+        : header_(0) {
+            Size bytes = requiredBytes(dimension, samplesPerBlock, blocks);
+            arena_.reset(new McArena(bytes));
+            initialize(arena_->allocate<char>(bytes),
+                       dimension, samplesPerBlock, blocks);
+        }
+        //! creates a store in a new memory-mapped file
+        McDrawStore(const std::string& fileName,
+                    Size dimension, Size samplesPerBlock, Size blocks)
+        : header_(0) {
+            using namespace boost::interprocess;
+            Size bytes = requiredBytes(dimension, samplesPerBlock, blocks);
+            {
+                std::filebuf file;
+                QL_REQUIRE(file.open(fileName.c_str(),
+                                     std::ios_base::in | std::ios_base::out |
+                                     std::ios_base::trunc |
+                                     std::ios_base::binary),
+                           "cannot create " << fileName);
+                file.pubseekoff(bytes-1, std::ios_base::beg);
+                file.sputc(0);
+            }
+            file_mapping mapping(fileName.c_str(), read_write);
+            region_.reset(new mapped_region(mapping, read_write, 0, bytes));
+            initialize(static_cast<char*>(region_->get_address()),
+                       dimension, samplesPerBlock, blocks);
+        }
+        //! maps an existing file read-only
+        explicit McDrawStore(const std::string& fileName)
+        : header_(0) {
+            using namespace boost::interprocess;
+            file_mapping mapping(fileName.c_str(), read_only);
+            region_.reset(new mapped_region(mapping, read_only));
+            Size bytes = region_->get_size();
+            QL_REQUIRE(bytes >= sizeof(Header),
+                       fileName << " is not a draw store");
+            header_ = static_cast<Header*>(region_->get_address());
+            QL_REQUIRE(header_->magic == magic &&
+                       header_->realSize == sizeof(Real),
+                       fileName << " is not a draw store written with "
+                       "this floating-point size");
+            QL_REQUIRE(bytes >= requiredBytes(header_->dimension,
+                                              header_->samplesPerBlock,
+                                              header_->blocks),
+                       fileName << " is truncated");
+            readOnly_ = true;
+        }
+        //! \name Inspectors
+        //@{
+        Size dimension() const { return Size(header_->dimension); }
+        Size samplesPerBlock() const {
+            return Size(header_->samplesPerBlock);
+        }
+        Size blocks() const { return Size(header_->blocks); }
+        bool readOnly() const { return readOnly_; }
+        //@}
+        //! \name Block access
+        //@{
+        const Real* draws(Size block) const {
+            return data() + block*samplesPerBlock()*dimension();
+        }
+        const Real* weights(Size block) const {
+            return data() + blocks()*samplesPerBlock()*dimension()
+                          + block*samplesPerBlock();
+        }
+        Real* mutableDraws(Size block) {
+            QL_REQUIRE(!readOnly_, "read-only draw store");
+            return const_cast<Real*>(draws(block));
+        }
+        Real* mutableWeights(Size block) {
+            QL_REQUIRE(!readOnly_, "read-only draw store");
+            return const_cast<Real*>(weights(block));
+        }
+        //@}
+        //! writes changes to a file-backed store to disk
+        void flush() {
+            if (region_ && !readOnly_)
+                region_->flush();
+        }
+      private:
+        // 64 bytes, so that the draws start on a cache line
+        struct Header {
+            boost::uint64_t magic, realSize;
+            boost::uint64_t dimension, samplesPerBlock, blocks;
+            boost::uint64_t reserved[3];
+        };
+        static const boost::uint64_t magic = 0x4d43445241575331ULL;
+        static Size requiredBytes(Size dimension,
+                                  Size samplesPerBlock,
+                                  Size blocks) {
+            QL_REQUIRE(dimension > 0 && samplesPerBlock > 0 && blocks > 0,
+                       "empty draw store");
+            return sizeof(Header)
+                 + blocks*samplesPerBlock*(dimension+1)*sizeof(Real);
+        }
+        void initialize(char* memory, Size dimension,
+                        Size samplesPerBlock, Size blocks) {
+            std::fill(memory, memory+sizeof(Header), 0);
+            header_ = reinterpret_cast<Header*>(memory);
+            header_->magic = magic;
+            header_->realSize = sizeof(Real);
+            header_->dimension = dimension;
+            header_->samplesPerBlock = samplesPerBlock;
+            header_->blocks = blocks;
+            readOnly_ = false;
+        }
+        const Real* data() const {
+            return reinterpret_cast<const Real*>(header_+1);
+        }
+        Header* header_;
+        bool readOnly_;
+        boost::scoped_ptr<McArena> arena_;
+        boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+    };
+
+}
+
+
+#endif
@@ -30,12 +30,557 @@
 #include <ql/processes/blackscholesprocess.hpp>
 #include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include "constantblackscholesprocess.hpp"
+#include "gridblackscholesprocess.hpp"
+#include "batchpathgenerator.hpp"
+#include "controlvariatestatistics.hpp"
+#include "randomizedsobolrsg.hpp"
+#include "reseedablersg.hpp"
+#include "philoxrsg.hpp"
+#include "bulkgaussianrsg.hpp"
+#include "mcallocationcounter.hpp"
+#include "mcdrawring.hpp"
+#include "mcdrawstore.hpp"
+#include "mccheckpoint.hpp"
+#include "mcshardresult.hpp"
+#include <ql/pricingengines/blackcalculator.hpp>
+#include <ql/math/statistics/incrementalstatistics.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace QuantLib {
 
+    namespace detail {
+
+        //! number of samples drawn from each independent random stream
+        /*! Samples are simulated in blocks of this size; each block
+            has its own generator, so that the samples do not depend
+            on the way blocks are assigned to threads.
+        */
+        const Size mcSamplesPerBlock = 1024;
+
+        //! number of replicas used when none is given
+        const Size mcDefaultReplicas = 16;
+
+        //! number of blocks a draw producer can get ahead of pricing
+        const Size mcDrawRingSlots = 4;
+
+        //! seed of the random stream used by the given block of samples
+        /*! The block index is mixed into the base seed with the
+            SplitMix64 finalizer so that neighbouring blocks start
+            from unrelated generator states.  Zero is never returned
+            since it would ask the generator for a random seed.
+        */
+        inline BigNatural mcBlockSeed(BigNatural seed, Size block) {
+            boost::uint64_t z = boost::uint64_t(seed) +
+                (boost::uint64_t(block) + 1) * 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= (z >> 31);
+            BigNatural result = BigNatural(z);
+            return result != 0 ? result : 1;
+        }
+
+        /*! whether the process is a Black-Scholes process with
+            strike-independent volatility, whose log-normal steps
+            are exact */
+        inline bool hasExactLogNormalTransition(
+                       const boost::shared_ptr<StochasticProcess>& process) {
+            boost::shared_ptr<GeneralizedBlackScholesProcess> bsProcess =
+                boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                                                                   process);
+            if (!bsProcess)
+                return false;
+            // the same test used by the process to decide on exact
+            // stepping
+            boost::shared_ptr<BlackVolTermStructure> vol =
+                bsProcess->blackVolatility().currentLink();
+            return boost::dynamic_pointer_cast<BlackConstantVol>(vol) ||
+                   boost::dynamic_pointer_cast<BlackVarianceCurve>(vol);
+        }
+
+        //! random sequence used by the given block of samples
+        /*! By default, each block draws from its own independent
+            stream.
+
+            rsg_type is the generator used for the blocks; make()
+            returns one at the start of a block, and restart() moves
+            it to the start of another block with the same seed and
+            replicas.  By default the generator is the one of the
+            random-number policy and restart() builds a new one,
+            which allocates; for the policies below, the generator is
+            reseeded or repositioned in place and draws the same
+            samples as the one of the policy.
+        */
+        template <class RNG>
+        struct McBlockSequence {
+            enum { replicated = 0 };
+            typedef typename RNG::rsg_type rsg_type;
+            static rsg_type make(Size dimension,
+                                 BigNatural seed,
+                                 Size block,
+                                 Size) {
+                return RNG::make_sequence_generator(
+                                  dimension, mcBlockSeed(seed, block));
+            }
+            static void restart(rsg_type& generator,
+                                BigNatural seed,
+                                Size block,
+                                Size replicas) {
+                generator = McBlockSequence::make(generator.dimension(),
+                                                  seed, block, replicas);
+            }
+        };
+
+        template <class IC>
+        struct McBlockSequence<
+                       GenericPseudoRandom<MersenneTwisterUniformRng,IC> > {
+            enum { replicated = 0 };
+            typedef RandomSequenceGenerator_2<MersenneTwisterUniformRng_2>
+                                                                   ursg_type;
+            typedef InverseCumulativeRsg_2<ursg_type,IC> rsg_type;
+            static rsg_type make(Size dimension, BigNatural seed,
+                                 Size block, Size) {
+                return rsg_type(ursg_type(dimension,
+                                          mcBlockSeed(seed, block)));
+            }
+            static void restart(rsg_type& generator, BigNatural seed,
+                                Size block, Size) {
+                generator.uniformSequenceGenerator().reseed(
+                                                  mcBlockSeed(seed, block));
+            }
+        };
+
+        template <>
+        struct McBlockSequence<GenericBulkGaussian<
+                    RandomSequenceGenerator<MersenneTwisterUniformRng> > > {
+            enum { replicated = 0 };
+            typedef RandomSequenceGenerator_2<MersenneTwisterUniformRng_2>
+                                                                   ursg_type;
+            typedef BulkGaussianRsg<ursg_type> rsg_type;
+            static rsg_type make(Size dimension, BigNatural seed,
+                                 Size block, Size) {
+                return rsg_type(ursg_type(dimension,
+                                          mcBlockSeed(seed, block)));
+            }
+            static void restart(rsg_type& generator, BigNatural seed,
+                                Size block, Size) {
+                generator.reseed(mcBlockSeed(seed, block));
+            }
+        };
+
+        /*! With randomized quasi-random sequences, blocks are dealt
+            in turn to a number of independently randomized replicas;
+            each block continues the sequence of its replica where the
+            previous block of the same replica stopped.
+        */
+        template <class IC>
+        struct McBlockSequence<GenericRandomizedLowDiscrepancy<IC> > {
+            enum { replicated = 1 };
+            typedef InverseCumulativeRsg_2<RandomizedSobolRsg,IC> rsg_type;
+            static rsg_type make(Size dimension, BigNatural seed,
+                                 Size block, Size replicas) {
+                rsg_type generator(RandomizedSobolRsg(
+                    dimension, mcBlockSeed(seed, block % replicas)));
+                generator.uniformSequenceGenerator().skipTo(
+                    boost::uint32_t((block / replicas) * mcSamplesPerBlock));
+                return generator;
+            }
+            static void restart(rsg_type& generator, BigNatural seed,
+                                Size block, Size replicas) {
+                RandomizedSobolRsg& sobol =
+                    generator.uniformSequenceGenerator();
+                sobol.reseed(mcBlockSeed(seed, block % replicas));
+                sobol.skipTo(
+                    boost::uint32_t((block / replicas) * mcSamplesPerBlock));
+            }
+        };
+
+        /*! Counter-based generators draw each path from its index,
+            so that the samples don't depend on the block size either.
+        */
+        template <class IC>
+        struct McBlockSequence<GenericCounterBased<IC> > {
+            enum { replicated = 0 };
+            typedef typename GenericCounterBased<IC>::rsg_type rsg_type;
+            static rsg_type make(Size dimension, BigNatural seed,
+                                 Size block, Size) {
+                return GenericCounterBased<IC>::make_sequence_generator(
+                    dimension, seed,
+                    boost::uint64_t(block) * mcSamplesPerBlock);
+            }
+            static void restart(rsg_type& generator, BigNatural,
+                                Size block, Size) {
+                generator.skipTo(boost::uint64_t(block) * mcSamplesPerBlock);
+            }
+        };
+
+        template <>
+        struct McBlockSequence<GenericBulkGaussian<PhiloxUniformRsg> > {
+            typedef GenericBulkGaussian<PhiloxUniformRsg> traits;
+            enum { replicated = 0 };
+            typedef traits::rsg_type rsg_type;
+            static rsg_type make(Size dimension, BigNatural seed,
+                                 Size block, Size) {
+                return traits::make_sequence_generator(
+                    dimension, seed,
+                    boost::uint64_t(block) * mcSamplesPerBlock);
+            }
+            static void restart(rsg_type& generator,
+                                BigNatural, Size block, Size) {
+                generator.skipTo(boost::uint64_t(block) * mcSamplesPerBlock);
+            }
+        };
+
+    }
+
+    //! fills a draw store for common random numbers
+    /*! Block \f$ b \f$ of the store receives the draws that
+        MCEuropeanEngine_2 would use for its \f$ b \f$-th block of
+        samples with the given seed, which must not be null; the
+        store dimension must be the number of time steps, or 1 for
+        terminal sampling.  Randomized quasi-random policies are not
+        supported, since their blocks depend on the number of
+        replicas.
+    */
+    template <class RNG>
+    void fillMcDrawStore(McDrawStore& store, BigNatural seed) {
+        typedef typename detail::McBlockSequence<RNG>::rsg_type
+            generator_type;
+        typedef typename generator_type::sample_type sequence_type;
+        QL_REQUIRE(!detail::McBlockSequence<RNG>::replicated,
+                   "randomized quasi-random policies not supported");
+        QL_REQUIRE(seed != 0, "null seed given");
+        QL_REQUIRE(store.samplesPerBlock() == detail::mcSamplesPerBlock,
+                   "draw store has " << store.samplesPerBlock()
+                   << " samples per block instead of "
+                   << detail::mcSamplesPerBlock);
+        const Size dimension = store.dimension();
+        for (Size b=0; b<store.blocks(); ++b) {
+            generator_type generator =
+                detail::McBlockSequence<RNG>::make(dimension, seed, b, 1);
+            Real* draws = store.mutableDraws(b);
+            Real* weights = store.mutableWeights(b);
+            for (Size i=0; i<store.samplesPerBlock(); ++i) {
+                const sequence_type& sequence = generator.nextSequence();
+                std::copy(sequence.value.begin(), sequence.value.end(),
+                          draws + i*dimension);
+                weights[i] = sequence.weight;
+            }
+        }
+        store.flush();
+    }
+
+    class EuropeanPathPricer_2;
+
+    //! control variates available to MCEuropeanEngine_2
+    struct EuropeanControlVariate_2 {
+        enum Type {
+            None,
+            /*! the same payoff on a Black-Scholes path with the
+                parameters at maturity, driven by the same Brownian
+                motion, whose value is known analytically */
+            AnalyticPrice,
+            //! the discounted underlying value at maturity
+            DiscountedUnderlying
+        };
+    };
+
+    //! sampling schemes available to MCEuropeanEngine_2
+    struct EuropeanSampling_2 {
+        enum Type {
+            //! independent draws from the random-number policy
+            Independent,
+            /*! the Gaussian variate driving the value at maturity is
+                stratified, with one sample per stratum in each block */
+            Stratified,
+            /*! Latin hypercube sampling: each Gaussian variate is
+                stratified in each block, with random pairings of the
+                strata of different dimensions */
+            LatinHypercube
+        };
+    };
+
+    //! state of a Monte Carlo run, passed to progress callbacks
+    struct MonteCarloProgress_2 {
+        Size samples;
+        Real value;
+        Real errorEstimate;
+        //! wall-clock time since the start of the calculation, in seconds
+        Real elapsedTime;
+    };
+
+    /*! called after each batch of samples; returning false cancels
+        the run, whose results are then the ones reached so far. */
+    typedef std::function<bool(const MonteCarloProgress_2&)>
+                                                 MonteCarloProgressCallback_2;
+
+    //! simulation settings of MCEuropeanEngine_2
+    /*! The defaults select the plain MCVanillaEngine simulation;
+        MakeMCEuropeanEngine_2 fills the other fields.  The modes are
+        described in the documentation of MCEuropeanEngine_2.
+    */
+    struct MCEuropeanEngineOptions_2 {
+        MCEuropeanEngineOptions_2()
+        : threads(Null<Size>()), terminalSampling(false),
+          constantParameters(false), gridParameters(false),
+          pathBatchSize(Null<Size>()), singlePrecision(false),
+          controlVariate(EuropeanControlVariate_2::None),
+          replicas(Null<Size>()), timeBudget(Null<Real>()),
+          greeks(false), sampling(EuropeanSampling_2::Independent),
+          momentMatching(false), importanceSampling(false),
+          drawPipeline(false), shard(Null<Size>()), shards(Null<Size>()),
+          checkpointInterval(60.0) {}
+        //! worker threads; null unless block mode is requested
+        Size threads;
+        bool terminalSampling;
+        bool constantParameters, gridParameters;
+        //! paths per batch; null for no batches
+        Size pathBatchSize;
+        bool singlePrecision;
+        EuropeanControlVariate_2::Type controlVariate;
+        //! null for detail::mcDefaultReplicas when replicas are used
+        Size replicas;
+        //! in seconds; null for no budget
+        Real timeBudget;
+        MonteCarloProgressCallback_2 progress;
+        bool greeks;
+        EuropeanSampling_2::Type sampling;
+        bool momentMatching, importanceSampling;
+        bool drawPipeline;
+        boost::shared_ptr<const McDrawStore> drawStore;
+        //! index and count of the shard; null for a whole run
+        Size shard, shards;
+        //! empty for no checkpoints
+        std::string checkpointFile;
+        //! in seconds
+        Real checkpointInterval;
+    };
+
     //! European option pricing engine using Monte Carlo simulation
     /*! \ingroup vanillaengines
 
+        The modes described below are selected by the given
+        MCEuropeanEngineOptions_2, which MakeMCEuropeanEngine_2
+        fills; by default, the engine works as MCVanillaEngine.
+
+        When a number of threads is given, the samples are split in
+        blocks of detail::mcSamplesPerBlock, each drawn from its own
+        random stream derived from the seed.  The blocks are shared
+        among the worker threads and their samples are added to the
+        statistics in block order, so that the results are the same
+        for a given seed regardless of the number of threads.
+
+        \warning in parallel mode the process and the path pricer are
+                 used concurrently by the worker threads.  One path is
+                 generated beforehand on the calling thread so that
+                 any lazily-calculated process data are set up.
+
+        In terminal-sampling mode, the engine skips the path
+        generation and draws the underlying value at maturity from
+        its exact log-normal distribution, using one Gaussian variate
+        per sample.  This requires a process whose transition is
+        known exactly, i.e., a Black-Scholes process whose volatility
+        does not depend on the strike (a BlackConstantVol or a
+        BlackVarianceCurve).  Terminal sampling always runs in
+        blocks as in parallel mode (on one thread unless specified).
+
+        When constant parameters are requested, the engine extracts
+        the risk-free rate, dividend yield and volatility at maturity
+        from the given process and simulates paths with an equivalent
+        ConstantBlackScholesProcess, thus avoiding term-structure
+        lookups at each step.
+
+        When grid parameters are requested instead, the engine keeps
+        the term structure of rates and volatility but samples it
+        once, on the time grid of the simulation, into a
+        GridBlackScholesProcess; each step then takes table lookups
+        instead of discount and variance queries.  With a
+        strike-independent volatility the paths are the same as with
+        the given process, up to rounding; otherwise, the local
+        volatility is interpolated on a grid of spots.  Grid and
+        constant parameters are exclusive, and grid parameters are
+        not used with terminal sampling, which takes a single step.
+
+        When a path-batch size is given, paths are generated in
+        batches by a BatchPathGenerator, optionally storing their
+        values in single precision, which is only available in this
+        mode.  As for terminal sampling, this requires a process with
+        exact log-normal transition.
+
+        In block mode, each worker thread owns a workspace whose
+        path and random-draw buffers are allocated once per
+        calculation, from an McArena, and reused by every block it
+        simulates.  The workspace also keeps its random-sequence
+        generator, which is moved to the start of each block by
+        detail::McBlockSequence::restart(); with pseudo-random,
+        randomized quasi-random and counter-based generators this is
+        done in place, and the simulation of a block performs no heap
+        allocation.  Other generators are rebuilt for each block.
+        Samples are added in batches of 16 blocks per thread (rounded
+        up to whole replica units), whose value buffers are allocated
+        by the first batch and reused by the next ones; the
+        statistics class might allocate when samples are added.  When
+        the program counts its allocations (see McAllocationCounter),
+        those made while simulating blocks and generating their draws
+        are returned as the "sampleLoopAllocations" additional result.
+
+        A control variate can be used in block mode.  Its optimal
+        coefficient is estimated from the samples by a
+        ControlVariateStatistics instance, which provides the value
+        and error estimate (and hence drives the tolerance); the
+        coefficient and the variance-reduction factor are returned as
+        the "controlVariateCoefficient" and "varianceReductionFactor"
+        additional results.  The statistics class still collects the
+        uncontrolled samples.
+
+        With a randomized quasi-random policy such as
+        RandomizedLowDiscrepancy, blocks are dealt in turn to a number
+        of independently randomized Sobol replicas (16 by default,
+        see detail::mcDefaultReplicas).
+        Value and error estimate are the mean and the standard error
+        of the replica means, so that the error shrinks at the rate
+        of the quasi-random sequence and can drive the tolerance,
+        even though the policy itself does not allow an error
+        estimate (its allowsErrorEstimate trait is false); in
+        tolerance mode, the number of points per replica is doubled
+        at each step.  Brownian-bridge path construction, which puts
+        the most important variations on the first dimensions, is
+        enabled by default by MakeMCEuropeanEngine_2 for these
+        policies.  The number of replicas is returned as the
+        "replicas" additional result.  Since replicas receive the
+        same number of whole blocks, a required number of samples
+        must be a multiple of the block size times the number of
+        replicas (16384 by default); a maximum number of samples
+        must be at least as large, and is rounded down to such a
+        multiple.  Control variates are not supported in this mode.
+
+        When a time budget or a progress callback is given, samples
+        are added in batches of one block per thread (one per replica
+        with randomized quasi-random policies) until the required
+        samples or tolerance are reached, the callback cancels the
+        run, or the next batch would end after the budget, based on
+        the duration of the last one; the time budget can thus be
+        exceeded by at most one batch.  The budget includes the setup
+        of the calculation.  A budget alone is also a valid stopping
+        criterion; the number of samples used is returned as the
+        "samples" additional result.
+
+        When Greeks are requested, delta and vega are estimated
+        pathwise and gamma by a likelihood-ratio weight applied to
+        the pathwise delta, i.e.,
+        \f[
+            \Delta = E\left[ D \phi 1_{\phi(S_T-K)>0}
+                              \frac{S_T}{S_0} \right], \quad
+            \Gamma = E\left[ D \phi 1_{\phi(S_T-K)>0}
+                              \frac{S_T}{S_0^2}
+                              \left( \frac{Z}{\sigma\sqrt{T}} - 1
+                              \right) \right], \quad
+            \mathcal{V} = E\left[ D \phi 1_{\phi(S_T-K)>0}
+                              S_T \sqrt{T} (Z - \sigma\sqrt{T})
+                              \right],
+        \f]
+        where \f$ \phi \f$ is 1 for calls and -1 for puts and
+        \f$ Z \f$ is the standardized Brownian motion at maturity,
+        recovered from \f$ S_T \f$.  The estimators are accumulated
+        on the same paths as the value; they assume log-normal
+        dynamics with the volatility at maturity and strike.  Their
+        standard errors are returned as the "deltaErrorEstimate",
+        "gammaErrorEstimate" and "vegaErrorEstimate" additional
+        results.
+
+        Stratified or Latin-hypercube sampling and moment matching
+        transform the Gaussian draws of each block as a whole: each
+        draw is moved into its stratum, and/or the sample mean and
+        variance of each variate are set to 0 and 1; with terminal
+        sampling, moment matching also rescales the values at
+        maturity so that their average is the exact forward.  The
+        samples of a block are then no longer independent, so blocks
+        are dealt to replicas as with randomized quasi-random
+        policies, with the same constraint on the number of samples,
+        and the error estimate is the standard error of the
+        replica means (the Greek error estimates still treat the
+        samples as independent).  Stratifying the terminal variate
+        requires terminal sampling or Brownian-bridge paths, which
+        MakeMCEuropeanEngine_2 enables.  Path batches, control
+        variates and randomized quasi-random policies are not
+        supported in these modes.
+
+        Importance sampling, meant for deep out-of-the-money options,
+        shifts the Brownian motion at maturity by
+        \f$ \mu\sqrt{T} \f$, where \f$ \mu \f$ is the mode of
+        \f$ \mathrm{payoff}(S_T(z))\,\varphi(z) \f$ under log-normal
+        dynamics, and weights each sample by the likelihood ratio
+        \f$ \exp(-\mu z - \mu^2/2) \f$ of its unshifted variate.  The
+        shift is returned as the "importanceShift" additional result,
+        and the ratio between the variance that plain sampling would
+        have had (estimated on the same samples) and the actual one
+        as "varianceReductionFactor".  Antithetic and control
+        variates, replicated sampling and path batches are not
+        supported in this mode.
+
+        With a draw pipeline, each pricing thread is paired with a
+        producer thread that generates the Gaussian draws of its
+        blocks ahead of time into a lock-free ring of
+        detail::mcDrawRingSlots blocks; the producer waits when the
+        ring is full.  Blocks are dealt to pricing threads in a fixed
+        round-robin order (see McDrawPipeline) instead of on demand,
+        and each block still uses its own random stream, so the
+        results are the same as without the pipeline.  Twice as many
+        threads as requested are thus running; the pipeline pays off
+        when generating draws is a sizable part of the work and spare
+        cores are available.
+        Path batches, stratified sampling and moment matching are not
+        supported in this mode.
+
+        Common random numbers can be read from a McDrawStore filled
+        beforehand, e.g., by fillMcDrawStore(), instead of being
+        generated; each block of samples then uses the corresponding
+        block of the store, without copying it, and the seed is not
+        used.  Engines pricing different instruments or scenarios
+        from the same store, in the same process or in others mapping
+        the same file, see the same draws.  The store must have the
+        right dimension and enough blocks for the required samples.
+        The draw pipeline, path batches, and stratified,
+        moment-matched or replicated sampling are not supported in
+        this mode.
+
+        A run can be split in shards, e.g., to spread it across
+        processes or machines: given a shard index and count, the
+        engine simulates only its share of the blocks of samples of
+        the whole run, which are the same blocks, from the same seed,
+        that a single run would simulate.  The per-block sums of its
+        samples are returned as the "shardResult" additional result,
+        an McShardResult that can be saved to a file; merging the
+        results of all shards gives the statistics of the whole run.
+        The value and error estimate of each shard are computed from
+        its own blocks (the error estimate is null with replicas).  A
+        seed and a number of samples are required, and control
+        variates, Greeks, time budgets and progress callbacks are not
+        supported.
+
+        Long runs, sharded or not, can be checkpointed: the per-block
+        sums of the completed blocks are appended to a binary file
+        (see McCheckpointFile) at the given interval and at the end
+        of the run.  If the file exists when the calculation starts,
+        the run resumes after the blocks it holds, which must have
+        been saved by the same run; since each block has its own
+        random stream, the results are the same as for an
+        uninterrupted run.  The time spent saving is returned as the
+        "checkpointTime" additional result.  The same restrictions
+        apply as for shards, and importance sampling is not
+        supported.
+
         \test the correctness of the returned value is tested by
               checking it against analytic results.
     */
@@ -50,6 +595,8 @@ namespace QuantLib {
             path_pricer_type;
         typedef typename MCVanillaEngine<SingleVariate,RNG,S>::stats_type
             stats_type;
+        typedef typename detail::McBlockSequence<RNG>::rsg_type
+            block_generator_type;
         // constructor
         MCEuropeanEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
@@ -60,9 +607,149 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed);
+             BigNatural seed,
+             const MCEuropeanEngineOptions_2& options =
+                                             MCEuropeanEngineOptions_2());
+        void calculate() const;
       protected:
         boost::shared_ptr<path_pricer_type> pathPricer() const;
+        boost::shared_ptr<path_generator_type> pathGenerator() const;
+        boost::shared_ptr<ConstantBlackScholesProcess>
+                                              constantProcess() const;
+        boost::shared_ptr<GridBlackScholesProcess> gridProcess() const;
+        //! process evolved along the grid in block mode
+        virtual boost::shared_ptr<StochasticProcess1D>
+                                              makeBlockProcess() const;
+        // parallel mode
+        struct Workspace : private boost::noncopyable {
+            Workspace()
+            : draws(0), blockDraws(0), strata(0), shuffler(1),
+              shifted(0), readyDraws(0), readyWeights(0) {}
+            McArena arena;
+            boost::shared_ptr<Path> path;
+            boost::shared_ptr<BrownianBridge> bridge;
+            Real* draws;
+            // whole-block draws for stratified or moment-matched sampling
+            Real* blockDraws;
+            Size* strata;
+            // reseeded at each stratified block
+            MersenneTwisterUniformRng_2 shuffler;
+            // draws shifted for importance sampling
+            Real* shifted;
+            // draws generated beforehand, by the producer thread or
+            // in a draw store, for the block being priced
+            const Real* readyDraws;
+            const Real* readyWeights;
+            boost::shared_ptr<BatchPathGenerator<double> > batch;
+            boost::shared_ptr<BatchPathGenerator<float> > floatBatch;
+            // restarted at each block; see blockGenerator().  With
+            // the draw pipeline, it is used by the producer thread
+            // filling the ring of the workspace instead.
+            boost::optional<block_generator_type> generator;
+        };
+        virtual bool blockMode() const;
+        // whether value and error come from independent replicas
+        bool replicatedBlocks() const;
+        Size roundToBlocks(Size samples) const;
+        boost::shared_ptr<Workspace> makeWorkspace() const;
+        // generator of the workspace, at the start of the given block
+        block_generator_type& blockGenerator(Workspace& workspace,
+                                             Size block) const;
+        // Gaussian variates per sample
+        Size blockDimension() const;
+        void addBlockSamples(Size samples) const;
+        // whether statistics are reduced from per-block sums
+        bool blockSums() const;
+        // sets the seed and the samples of a resumed run
+        boost::shared_ptr<McCheckpointWriter> resumeCheckpoint(
+                                        const McShardRange& range) const;
+        // adds samples up to the given total, in batches of a few
+        // blocks per thread, saving a checkpoint after each batch
+        void addBatchedSamples(Size samples,
+                               McCheckpointWriter* checkpoint = 0) const;
+        void addToleranceSamples() const;
+        void fillDraws(Workspace& workspace,
+                       McDrawRing::Slot& slot,
+                       Size block,
+                       Size samples) const;
+        void addProgressiveSamples(
+                 std::chrono::steady_clock::time_point start) const;
+        Real blockValue() const;
+        Real blockErrorEstimate() const;
+        virtual void simulateBlock(Workspace& workspace,
+                                   Size block,
+                                   Size samples,
+                                   Real* values,
+                                   Real* weights,
+                                   Real* controls,
+                                   Real* greeks,
+                                   Real* ratios) const;
+        const Path& evolvePath(Path& path,
+                               const Real* draws,
+                               Real sign) const;
+        template <class GSG>
+        void drawBlock(GSG& generator,
+                       Workspace& workspace,
+                       Size block,
+                       Size samples,
+                       Size dimension,
+                       Real* weights) const;
+        // log-normal sampling
+        bool exactLogNormal() const;
+        template <class T>
+        void simulateBatchedBlock(BatchPathGenerator<T>& paths,
+                                  block_generator_type& generator,
+                                  Size samples,
+                                  Real* values,
+                                  Real* weights,
+                                  Real* controls,
+                                  Real* greeks) const;
+        void setupTerminalSampling() const;
+        void simulateTerminalBlock(Workspace& workspace,
+                                   Size block,
+                                   Size samples,
+                                   Real* values,
+                                   Real* weights,
+                                   Real* controls,
+                                   Real* greeks,
+                                   Real* ratios) const;
+        // control variate
+        void setupControlVariate() const;
+        Real controlValue(Real underlying, Real brownianValue) const;
+        // Greeks
+        void setupGreeks() const;
+        void addGreeks(Real underlying, Real weight, Real* greeks) const;
+        // importance sampling
+        void setupImportanceSampling() const;
+        MCEuropeanEngineOptions_2 options_;
+        mutable stats_type blockAccumulator_;
+        mutable Size blockSamples_;
+        mutable BigNatural blockSeed_;
+        // first block simulated by this shard
+        mutable Size blockOffset_;
+        mutable McShardResult shardResult_;
+        mutable TimeGrid blockGrid_;
+        mutable boost::shared_ptr<StochasticProcess1D> blockProcess_;
+        mutable boost::shared_ptr<path_pricer_type> blockPricer_;
+        mutable boost::shared_ptr<EuropeanPathPricer_2> europeanPricer_;
+        mutable std::vector<boost::shared_ptr<Workspace> > workspaces_;
+        mutable boost::shared_ptr<McDrawPipeline> pipeline_;
+        mutable Size sampleLoopAllocations_;
+        mutable std::vector<Real> blockValues_, blockWeights_, blockControls_;
+        mutable ControlVariateStatistics controlStatistics_;
+        mutable Real controlMean_, controlSpot_, controlDrift_;
+        mutable Real controlVolatility_, controlDiscount_;
+        mutable std::vector<Real> controlSqrtDt_;
+        mutable Size blockReplicas_;
+        mutable std::vector<Real> replicaSums_, replicaWeights_;
+        mutable std::vector<Real> blockGreeks_;
+        mutable IncrementalStatistics greekStatistics_[3];
+        mutable Real greekSpot_, greekStrike_, greekSign_, greekDiscount_;
+        mutable Real greekDrift_, greekStdDev_, greekSqrtT_;
+        mutable Real terminalSpot_, terminalDrift_, terminalStdDev_;
+        mutable Real importanceShift_;
+        mutable std::vector<Real> importanceDirection_, blockRatios_;
+        mutable Real importanceSquares_, importanceWeights_;
     };
 
     //! Monte Carlo European engine factory
@@ -80,15 +767,48 @@ namespace QuantLib {
         MakeMCEuropeanEngine_2& withMaxSamples(Size samples);
         MakeMCEuropeanEngine_2& withSeed(BigNatural seed);
         MakeMCEuropeanEngine_2& withAntitheticVariate(bool b = true);
+        MakeMCEuropeanEngine_2& withThreads(Size n);
+        MakeMCEuropeanEngine_2& withTerminalSampling(bool b = true);
+        MakeMCEuropeanEngine_2& withConstantParameters(bool b = true);
+        MakeMCEuropeanEngine_2& withGridParameters(bool b = true);
+        MakeMCEuropeanEngine_2& withPathBatches(Size batchSize);
+        MakeMCEuropeanEngine_2& withSinglePrecision(bool b = true);
+        MakeMCEuropeanEngine_2& withControlVariate(
+               EuropeanControlVariate_2::Type type =
+                                     EuropeanControlVariate_2::AnalyticPrice);
+        MakeMCEuropeanEngine_2& withReplicas(Size replicas);
+        template <class Rep, class Period>
+        MakeMCEuropeanEngine_2& withTimeBudget(
+                          const std::chrono::duration<Rep,Period>& budget);
+        MakeMCEuropeanEngine_2& withProgressCallback(
+                             const MonteCarloProgressCallback_2& callback);
+        MakeMCEuropeanEngine_2& withGreeks(bool b = true);
+        MakeMCEuropeanEngine_2& withSampling(EuropeanSampling_2::Type type);
+        MakeMCEuropeanEngine_2& withMomentMatching(bool b = true);
+        MakeMCEuropeanEngine_2& withImportanceSampling(bool b = true);
+        MakeMCEuropeanEngine_2& withDrawPipeline(bool b = true);
+        MakeMCEuropeanEngine_2& withDrawStore(
+                           const boost::shared_ptr<const McDrawStore>& store);
+        MakeMCEuropeanEngine_2& withShard(Size shard, Size shards);
+        MakeMCEuropeanEngine_2& withCheckpoint(const std::string& fileName,
+                                               Real interval = 60.0);
         // conversion to pricing engine
         operator boost::shared_ptr<PricingEngine>() const;
+        /*! returns an MCSpecializedEuropeanEngine_2 for the given
+            process and payoff types; defined in
+            mcspecializedeuropeanengine.hpp */
+        template <class ProcessType, class PayoffType>
+        boost::shared_ptr<PricingEngine> specializedEngine() const;
       private:
+        template <class Engine>
+        boost::shared_ptr<PricingEngine> makeEngine() const;
         boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
         bool antithetic_;
         Size steps_, stepsPerYear_, samples_, maxSamples_;
         Real tolerance_;
         bool brownianBridge_;
         BigNatural seed_;
+        MCEuropeanEngineOptions_2 options_;
     };
 
     class EuropeanPathPricer_2 : public PathPricer<Path> {
@@ -97,6 +817,8 @@ namespace QuantLib {
                              Real strike,
                              DiscountFactor discount);
         Real operator()(const Path& path) const;
+        //! discounted payoff given the underlying value at maturity
+        Real operator()(Real underlying) const;
       private:
         PlainVanillaPayoff payoff_;
         DiscountFactor discount_;
@@ -116,7 +838,8 @@ namespace QuantLib {
              Size requiredSamples,
              Real requiredTolerance,
              Size maxSamples,
-             BigNatural seed)
+             BigNatural seed,
+             const MCEuropeanEngineOptions_2& options)
     : MCVanillaEngine<SingleVariate,RNG,S>(process,
                                            timeSteps,
                                            timeStepsPerYear,
@@ -126,7 +849,1318 @@ namespace QuantLib {
                                            requiredSamples,
                                            requiredTolerance,
                                            maxSamples,
-                                           seed) {}
+                                           seed),
+      options_(options),
+      blockSamples_(0), blockSeed_(0), blockOffset_(0),
+      sampleLoopAllocations_(0),
+      controlMean_(0.0), controlSpot_(0.0), controlDrift_(0.0),
+      controlVolatility_(0.0), controlDiscount_(0.0), blockReplicas_(1),
+      greekSpot_(0.0), greekStrike_(0.0), greekSign_(0.0),
+      greekDiscount_(0.0), greekDrift_(0.0), greekStdDev_(0.0),
+      greekSqrtT_(0.0),
+      terminalSpot_(0.0), terminalDrift_(0.0), terminalStdDev_(0.0),
+      importanceShift_(0.0), importanceSquares_(0.0),
+      importanceWeights_(0.0) {
+        QL_REQUIRE(options_.threads == Null<Size>() || options_.threads > 0,
+                   "at least one thread required");
+        QL_REQUIRE(options_.pathBatchSize == Null<Size>() ||
+                   options_.pathBatchSize > 0,
+                   "null path-batch size given");
+        // only batched paths are stored in single precision
+        QL_REQUIRE(!options_.singlePrecision ||
+                   options_.pathBatchSize != Null<Size>(),
+                   "single precision requires path batches");
+        QL_REQUIRE(!options_.terminalSampling ||
+                   options_.pathBatchSize == Null<Size>(),
+                   "terminal sampling and path batches are exclusive");
+        QL_REQUIRE(!options_.gridParameters || !options_.constantParameters,
+                   "grid and constant parameters are exclusive");
+        QL_REQUIRE(!options_.gridParameters || !options_.terminalSampling,
+                   "grid parameters not used with terminal sampling");
+        // replicas are independent even when the samples aren't
+        QL_REQUIRE(!blockMode() || RNG::allowsErrorEstimate ||
+                   detail::McBlockSequence<RNG>::replicated,
+                   "chosen random generator policy "
+                   "cannot be split in independent streams");
+        QL_REQUIRE(options_.replicas == Null<Size>() || replicatedBlocks(),
+                   "replicas require a randomized quasi-random policy, "
+                   "or stratified or moment-matched sampling");
+        QL_REQUIRE(options_.replicas == Null<Size>() || options_.replicas > 1,
+                   "at least two replicas required");
+        if (replicatedBlocks()) {
+            // replicas receive the same number of whole blocks; a
+            // maximum is rounded down to whole units when reached
+            Size replicas = (options_.replicas != Null<Size>() ?
+                             options_.replicas : detail::mcDefaultReplicas);
+            Size unit = detail::mcSamplesPerBlock*replicas;
+            QL_REQUIRE(requiredSamples == Null<Size>() ||
+                       requiredSamples % unit == 0,
+                       requiredSamples << " samples required; with "
+                       << replicas << " replicas, the number of samples "
+                       "must be a multiple of " << unit);
+            QL_REQUIRE(maxSamples == Null<Size>() || maxSamples >= unit,
+                       maxSamples << " maximum samples given; with "
+                       << replicas << " replicas, at least " << unit
+                       << " are needed");
+        }
+        QL_REQUIRE(options_.timeBudget == Null<Real>() ||
+                   options_.timeBudget > 0.0,
+                   "positive time budget required");
+        QL_REQUIRE(!replicatedBlocks() ||
+                   options_.controlVariate == EuropeanControlVariate_2::None,
+                   "control variates not supported with replicas");
+        bool blockSampling =
+            (options_.sampling != EuropeanSampling_2::Independent ||
+             options_.momentMatching);
+        QL_REQUIRE(!blockSampling ||
+                   !detail::McBlockSequence<RNG>::replicated,
+                   "stratified or moment-matched sampling not supported "
+                   "with randomized quasi-random policies");
+        QL_REQUIRE(!blockSampling || options_.pathBatchSize == Null<Size>(),
+                   "stratified or moment-matched sampling not supported "
+                   "with path batches");
+        QL_REQUIRE(options_.sampling != EuropeanSampling_2::Stratified ||
+                   options_.terminalSampling || brownianBridge,
+                   "stratified sampling requires terminal sampling or "
+                   "Brownian-bridge paths");
+        if (options_.importanceSampling) {
+            QL_REQUIRE(!antitheticVariate,
+                       "antithetic variates not supported with "
+                       "importance sampling");
+            QL_REQUIRE(options_.controlVariate ==
+                                              EuropeanControlVariate_2::None,
+                       "control variates not supported with "
+                       "importance sampling");
+            QL_REQUIRE(!replicatedBlocks(),
+                       "importance sampling not supported with replicas");
+            QL_REQUIRE(options_.pathBatchSize == Null<Size>(),
+                       "importance sampling not supported with path "
+                       "batches");
+        }
+        if (options_.drawPipeline) {
+            QL_REQUIRE(options_.pathBatchSize == Null<Size>(),
+                       "draw pipeline not supported with path batches");
+            QL_REQUIRE(options_.sampling == EuropeanSampling_2::Independent &&
+                       !options_.momentMatching,
+                       "draw pipeline not supported with stratified or "
+                       "moment-matched sampling");
+        }
+        if (options_.drawStore) {
+            QL_REQUIRE(!options_.drawPipeline &&
+                       options_.pathBatchSize == Null<Size>() &&
+                       !replicatedBlocks(),
+                       "draw store not supported with draw pipeline, path "
+                       "batches, or stratified, moment-matched or "
+                       "replicated sampling");
+            QL_REQUIRE(options_.drawStore->samplesPerBlock() ==
+                                                detail::mcSamplesPerBlock,
+                       "draw store has "
+                       << options_.drawStore->samplesPerBlock()
+                       << " samples per block instead of "
+                       << detail::mcSamplesPerBlock);
+        }
+        if (options_.shards != Null<Size>()) {
+            QL_REQUIRE(options_.shard != Null<Size>() &&
+                       options_.shard < options_.shards,
+                       "shard " << options_.shard << " out of "
+                       << options_.shards << " given");
+            // as for fillMcDrawStore, all shards must draw the
+            // blocks of the same run
+            QL_REQUIRE(seed != 0, "null seed given for a sharded run");
+        }
+        if (!options_.checkpointFile.empty()) {
+            QL_REQUIRE(options_.checkpointInterval >= 0.0,
+                       "negative checkpoint interval given");
+            QL_REQUIRE(!options_.importanceSampling,
+                       "importance sampling not supported in "
+                       "checkpointed runs");
+        }
+        if (blockSums()) {
+            QL_REQUIRE(requiredSamples != Null<Size>() &&
+                       requiredTolerance == Null<Real>(),
+                       "sharded or checkpointed runs require a number "
+                       "of samples and no tolerance");
+            QL_REQUIRE(options_.timeBudget == Null<Real>() &&
+                       !options_.progress,
+                       "time budget and progress callback not supported "
+                       "in sharded or checkpointed runs");
+            QL_REQUIRE(options_.controlVariate ==
+                                           EuropeanControlVariate_2::None &&
+                       !options_.greeks,
+                       "control variates and Greeks not supported in "
+                       "sharded or checkpointed runs");
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline bool MCEuropeanEngine_2<RNG,S>::blockMode() const {
+        return options_.threads != Null<Size>()
+            || options_.terminalSampling
+            || options_.pathBatchSize != Null<Size>()
+            || options_.controlVariate != EuropeanControlVariate_2::None
+            || replicatedBlocks()
+            || options_.timeBudget != Null<Real>()
+            || options_.progress
+            || options_.greeks
+            || options_.importanceSampling
+            || options_.drawPipeline
+            || options_.drawStore
+            || blockSums();
+    }
+
+
+    template <class RNG, class S>
+    inline bool MCEuropeanEngine_2<RNG,S>::blockSums() const {
+        return options_.shards != Null<Size>()
+            || !options_.checkpointFile.empty();
+    }
+
+
+    template <class RNG, class S>
+    inline Size MCEuropeanEngine_2<RNG,S>::blockDimension() const {
+        return options_.terminalSampling ? 1 : blockGrid_.size()-1;
+    }
+
+
+    template <class RNG, class S>
+    inline bool MCEuropeanEngine_2<RNG,S>::replicatedBlocks() const {
+        // samples drawn as a whole block are not independent, but
+        // blocks are
+        return detail::McBlockSequence<RNG>::replicated
+            || options_.sampling != EuropeanSampling_2::Independent
+            || options_.momentMatching;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::calculate() const {
+
+        if (!blockMode()) {
+            MCVanillaEngine<SingleVariate,RNG,S>::calculate();
+            return;
+        }
+
+        QL_REQUIRE(this->requiredTolerance_ != Null<Real>() ||
+                   this->requiredSamples_ != Null<Size>() ||
+                   options_.timeBudget != Null<Real>(),
+                   "neither tolerance, number of samples nor time "
+                   "budget set");
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        blockAccumulator_.reset();
+        controlStatistics_.reset();
+        for (Size k=0; k<3; ++k)
+            greekStatistics_[k].reset();
+        importanceSquares_ = importanceWeights_ = 0.0;
+        blockSamples_ = 0;
+        blockOffset_ = 0;
+        sampleLoopAllocations_ = 0;
+        if (replicatedBlocks())
+            blockReplicas_ = (options_.replicas != Null<Size>() ?
+                              options_.replicas : detail::mcDefaultReplicas);
+        else
+            blockReplicas_ = 1;
+        replicaSums_.assign(blockReplicas_, 0.0);
+        shardResult_ = McShardResult();
+        replicaWeights_.assign(blockReplicas_, 0.0);
+        blockSeed_ = (this->seed_ != 0 ? this->seed_ :
+                                         SeedGenerator::instance().get());
+        blockGrid_ = this->timeGrid();
+        if (options_.drawStore) {
+            QL_REQUIRE(options_.drawStore->dimension() == blockDimension(),
+                       "draw store has dimension "
+                       << options_.drawStore->dimension() << " instead of "
+                       << blockDimension());
+        }
+        blockProcess_ = makeBlockProcess();
+        QL_REQUIRE(blockProcess_, "1-D stochastic process required");
+        blockPricer_ = this->pathPricer();
+        europeanPricer_ =
+            boost::dynamic_pointer_cast<EuropeanPathPricer_2>(blockPricer_);
+        QL_REQUIRE(europeanPricer_, "European path pricer required");
+        if (options_.terminalSampling) {
+            setupTerminalSampling();
+        } else if (options_.pathBatchSize != Null<Size>()) {
+            QL_REQUIRE(exactLogNormal(),
+                       "path batches require a log-normal process with "
+                       "strike-independent volatility");
+        } else if (!options_.gridParameters) {
+            // set up lazy process data before the workers share it
+            this->pathGenerator()->next();
+        }
+
+        if (options_.controlVariate != EuropeanControlVariate_2::None)
+            setupControlVariate();
+        if (options_.greeks)
+            setupGreeks();
+        if (options_.importanceSampling)
+            setupImportanceSampling();
+
+        // a checkpoint sets the seed used by the workspaces
+        Size shardSamples = 0;
+        boost::shared_ptr<McCheckpointWriter> checkpoint;
+        if (blockSums()) {
+            McShardRange range(this->requiredSamples_,
+                               detail::mcSamplesPerBlock,
+                               options_.shards != Null<Size>() ?
+                                   options_.shard : 0,
+                               options_.shards != Null<Size>() ?
+                                   options_.shards : 1);
+            blockOffset_ = range.firstBlock();
+            shardSamples = range.samples();
+            shardResult_ = McShardResult(blockReplicas_, blockSeed_,
+                                         range.totalSamples(),
+                                         blockDimension());
+            if (!options_.checkpointFile.empty())
+                checkpoint = resumeCheckpoint(range);
+        }
+
+        Size nThreads = (options_.threads != Null<Size>() ?
+                         options_.threads : 1);
+        workspaces_.resize(nThreads);
+        for (Size i=0; i<nThreads; ++i)
+            workspaces_[i] = makeWorkspace();
+        if (options_.drawPipeline)
+            pipeline_.reset(new McDrawPipeline(nThreads,
+                                               detail::mcDrawRingSlots,
+                                               detail::mcSamplesPerBlock,
+                                               blockDimension()));
+
+        if (blockSums())
+            addBatchedSamples(shardSamples, checkpoint.get());
+        else if (options_.timeBudget != Null<Real>() || options_.progress)
+            addProgressiveSamples(start);
+        else if (this->requiredTolerance_ != Null<Real>())
+            addToleranceSamples();
+        else
+            addBatchedSamples(this->requiredSamples_);
+
+        if (blockSums()) {
+            // computed as they would be after merging the shards;
+            // replicas can't be compared within a single shard
+            this->results_.value = shardResult_.mean();
+            bool sharded = (options_.shards != Null<Size>() &&
+                            options_.shards > 1);
+            this->results_.errorEstimate =
+                (replicatedBlocks() && sharded) ?
+                    Null<Real>() : shardResult_.errorEstimate();
+            this->results_.additionalResults["shardResult"] = shardResult_;
+            if (checkpoint)
+                this->results_.additionalResults["checkpointTime"] =
+                    checkpoint->time();
+        } else {
+            this->results_.value = blockValue();
+            this->results_.errorEstimate = blockErrorEstimate();
+        }
+        this->results_.additionalResults["samples"] = blockSamples_;
+        if (McAllocationCounter::enabled())
+            this->results_.additionalResults["sampleLoopAllocations"] =
+                sampleLoopAllocations_;
+        if (options_.greeks) {
+            this->results_.delta = greekStatistics_[0].mean();
+            this->results_.gamma = greekStatistics_[1].mean();
+            this->results_.vega = greekStatistics_[2].mean();
+            this->results_.additionalResults["deltaErrorEstimate"] =
+                greekStatistics_[0].errorEstimate();
+            this->results_.additionalResults["gammaErrorEstimate"] =
+                greekStatistics_[1].errorEstimate();
+            this->results_.additionalResults["vegaErrorEstimate"] =
+                greekStatistics_[2].errorEstimate();
+        }
+        if (options_.controlVariate != EuropeanControlVariate_2::None) {
+            this->results_.additionalResults["controlVariateCoefficient"] =
+                controlStatistics_.coefficient();
+            this->results_.additionalResults["varianceReductionFactor"] =
+                controlStatistics_.varianceReductionFactor();
+        }
+        if (replicatedBlocks())
+            this->results_.additionalResults["replicas"] = blockReplicas_;
+        if (options_.importanceSampling) {
+            Real mean = blockValue();
+            Real plainVariance = std::max<Real>(
+                importanceSquares_/importanceWeights_ - mean*mean, 0.0);
+            this->results_.additionalResults["importanceShift"] =
+                importanceShift_;
+            this->results_.additionalResults["varianceReductionFactor"] =
+                plainVariance/blockAccumulator_.variance();
+        }
+        workspaces_.clear();
+        pipeline_.reset();
+    }
+
+
+    template <class RNG, class S>
+    inline Size MCEuropeanEngine_2<RNG,S>::roundToBlocks(Size samples) const {
+        // replicas always receive the same number of blocks
+        const Size blockSize = detail::mcSamplesPerBlock * blockReplicas_;
+        return ((samples + blockSize - 1) / blockSize) * blockSize;
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCEuropeanEngine_2<RNG,S>::blockValue() const {
+        if (options_.controlVariate != EuropeanControlVariate_2::None)
+            return controlStatistics_.mean(controlMean_);
+        if (!replicatedBlocks())
+            return blockAccumulator_.mean();
+
+        Real sum = 0.0;
+        for (Size i=0; i<blockReplicas_; ++i)
+            sum += replicaSums_[i]/replicaWeights_[i];
+        return sum/blockReplicas_;
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<McCheckpointWriter>
+    MCEuropeanEngine_2<RNG,S>::resumeCheckpoint(
+                                          const McShardRange& range) const {
+        boost::shared_ptr<McCheckpointWriter> checkpoint(
+            new McCheckpointWriter(options_.checkpointFile,
+                                   options_.checkpointInterval));
+        McCheckpointFile::Header header = McCheckpointFile::header(
+            blockSeed_, range.totalSamples(), blockDimension(),
+            range.firstBlock(), range.lastBlock(), blockReplicas_);
+        // a random seed is recovered from the checkpoint
+        shardResult_ = checkpoint->resume(header, this->seed_ == 0);
+        blockSeed_ = BigNatural(header.seed);
+        blockSamples_ = shardResult_.samples();
+        return checkpoint;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addBatchedSamples(
+                                   Size samples,
+                                   McCheckpointWriter* checkpoint) const {
+        // batches of several blocks per thread keep the cost of
+        // starting the workers and checking the clock negligible,
+        // while bounding the buffers of a batch; since samples are
+        // reduced in block order, the results don't depend on them
+        Size batch = roundToBlocks(16*workspaces_.size()*
+                                   detail::mcSamplesPerBlock);
+        while (blockSamples_ < samples) {
+            addBlockSamples(std::min(batch, samples-blockSamples_));
+            if (checkpoint)
+                checkpoint->save(shardResult_, blockSamples_ == samples);
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addToleranceSamples() const {
+        // same strategy as McSimulation::value, but in whole blocks
+        // so that each batch starts with a fresh random stream
+        Real tolerance = this->requiredTolerance_;
+        Size maxSamples = (this->maxSamples_ != Null<Size>() ?
+                           this->maxSamples_ : Size(QL_MAX_INTEGER));
+        if (replicatedBlocks()) {
+            // the last batch gives the same blocks to all replicas
+            const Size unit = detail::mcSamplesPerBlock*blockReplicas_;
+            maxSamples = (maxSamples/unit)*unit;
+        }
+        const Size minSamples = 1023;
+
+        addBatchedSamples(std::min(roundToBlocks(minSamples), maxSamples));
+        Real error = blockErrorEstimate();
+        while (error > tolerance) {
+            QL_REQUIRE(blockSamples_ < maxSamples,
+                       "max number of samples (" << maxSamples
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance ("
+                       << tolerance << ")");
+            Size nextBatch;
+            if (detail::McBlockSequence<RNG>::replicated) {
+                // doubling keeps each replica a balanced set of
+                // Sobol points, whose error decreases faster than
+                // the one assumed below
+                nextBatch = blockSamples_;
+            } else {
+                Real order = (error*error)/tolerance/tolerance;
+                nextBatch = Size(std::max<Real>(
+                    static_cast<Real>(blockSamples_)*order*0.8
+                        - static_cast<Real>(blockSamples_),
+                    static_cast<Real>(minSamples)));
+            }
+            nextBatch = std::min(roundToBlocks(nextBatch),
+                                 maxSamples-blockSamples_);
+            addBatchedSamples(blockSamples_ + nextBatch);
+            error = blockErrorEstimate();
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addProgressiveSamples(
+                   std::chrono::steady_clock::time_point start) const {
+        typedef std::chrono::steady_clock clock;
+        Size nThreads = workspaces_.size();
+        Size batch = roundToBlocks(nThreads*detail::mcSamplesPerBlock);
+        Size target = this->requiredSamples_;
+        if (target == Null<Size>()) {
+            target = (this->maxSamples_ != Null<Size>() ?
+                      this->maxSamples_ : Size(QL_MAX_INTEGER));
+            if (replicatedBlocks()) {
+                // see addToleranceSamples()
+                const Size unit = detail::mcSamplesPerBlock*blockReplicas_;
+                target = (target/unit)*unit;
+            }
+        }
+        Real tolerance = this->requiredTolerance_;
+
+        Real lastBatchTime = 0.0;
+        while (blockSamples_ < target) {
+            clock::time_point batchStart = clock::now();
+            if (options_.timeBudget != Null<Real>() && blockSamples_ > 0) {
+                Real elapsed =
+                    std::chrono::duration<Real>(batchStart-start).count();
+                if (elapsed + lastBatchTime > options_.timeBudget)
+                    break;
+            }
+
+            addBlockSamples(std::min(batch, target-blockSamples_));
+            clock::time_point batchEnd = clock::now();
+            lastBatchTime =
+                std::chrono::duration<Real>(batchEnd-batchStart).count();
+
+            // a single sample gives no error estimate
+            Real error = blockSamples_ > 1 ? blockErrorEstimate()
+                                           : QL_MAX_REAL;
+            if (options_.progress) {
+                MonteCarloProgress_2 progress;
+                progress.samples = blockSamples_;
+                progress.value = blockValue();
+                progress.errorEstimate = error;
+                progress.elapsedTime =
+                    std::chrono::duration<Real>(batchEnd-start).count();
+                if (!options_.progress(progress))
+                    break;
+            }
+            if (tolerance != Null<Real>() && error <= tolerance)
+                break;
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCEuropeanEngine_2<RNG,S>::blockErrorEstimate() const {
+        if (options_.controlVariate != EuropeanControlVariate_2::None)
+            return controlStatistics_.errorEstimate();
+        if (!replicatedBlocks())
+            return blockAccumulator_.errorEstimate();
+
+        // standard error of the replica means
+        Real mean = blockValue(), sum = 0.0;
+        for (Size i=0; i<blockReplicas_; ++i) {
+            Real d = replicaSums_[i]/replicaWeights_[i] - mean;
+            sum += d*d;
+        }
+        return std::sqrt(sum/(blockReplicas_*(blockReplicas_-1)));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::Workspace>
+    MCEuropeanEngine_2<RNG,S>::makeWorkspace() const {
+        boost::shared_ptr<Workspace> workspace(new Workspace);
+        if (options_.pathBatchSize != Null<Size>()) {
+            Size batchSize =
+                std::min(options_.pathBatchSize, detail::mcSamplesPerBlock);
+            if (options_.singlePrecision)
+                workspace->floatBatch.reset(new BatchPathGenerator<float>(
+                    blockProcess_, blockGrid_, this->brownianBridge_,
+                    batchSize, workspace->arena));
+            else
+                workspace->batch.reset(new BatchPathGenerator<double>(
+                    blockProcess_, blockGrid_, this->brownianBridge_,
+                    batchSize, workspace->arena));
+        } else if (!options_.terminalSampling) {
+            workspace->path.reset(new Path(blockGrid_));
+            workspace->bridge.reset(new BrownianBridge(blockGrid_));
+            workspace->draws =
+                workspace->arena.allocate<Real>(blockGrid_.size()-1);
+            if (options_.importanceSampling)
+                workspace->shifted =
+                    workspace->arena.allocate<Real>(blockGrid_.size()-1);
+        }
+        Size dimension = blockDimension();
+        if (options_.sampling != EuropeanSampling_2::Independent ||
+            options_.momentMatching) {
+            workspace->blockDraws = workspace->arena.allocate<Real>(
+                                    detail::mcSamplesPerBlock*dimension);
+            workspace->strata =
+                workspace->arena.allocate<Size>(detail::mcSamplesPerBlock);
+        }
+        workspace->generator = detail::McBlockSequence<RNG>::make(
+            dimension, blockSeed_, 0, blockReplicas_);
+        return workspace;
+    }
+
+
+    template <class RNG, class S>
+    inline typename MCEuropeanEngine_2<RNG,S>::block_generator_type&
+    MCEuropeanEngine_2<RNG,S>::blockGenerator(Workspace& workspace,
+                                              Size block) const {
+        detail::McBlockSequence<RNG>::restart(*workspace.generator,
+                                              blockSeed_, block,
+                                              blockReplicas_);
+        return *workspace.generator;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addBlockSamples(
+                                                        Size samples) const {
+        // batches always start on a block boundary; see calculate()
+        const Size blockSize = detail::mcSamplesPerBlock;
+        Size firstBlock = blockOffset_ + blockSamples_ / blockSize;
+        Size blocks = (samples + blockSize - 1) / blockSize;
+        if (blocks == 0)
+            return;
+
+        // capacity is kept from one batch to the next
+        blockValues_.resize(samples);
+        blockWeights_.resize(samples);
+        Real* values = &blockValues_[0];
+        Real* weights = &blockWeights_[0];
+        Real* controls = 0;
+        if (options_.controlVariate != EuropeanControlVariate_2::None) {
+            blockControls_.resize(samples);
+            controls = &blockControls_[0];
+        }
+        Real* greeks = 0;
+        if (options_.greeks) {
+            blockGreeks_.resize(3*samples);
+            greeks = &blockGreeks_[0];
+        }
+        Real* ratios = 0;
+        if (options_.importanceSampling) {
+            blockRatios_.resize(samples);
+            ratios = &blockRatios_[0];
+        }
+        QL_REQUIRE(!options_.drawStore ||
+                   firstBlock+blocks <= options_.drawStore->blocks(),
+                   "draw store holds " << options_.drawStore->blocks()
+                   << " blocks, " << firstBlock+blocks << " needed");
+        Size nWorkers = std::min(workspaces_.size(), blocks);
+        std::atomic<Size> nextBlock(0);
+        std::atomic<Size> allocations(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto fail = [&]() {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+            nextBlock = blocks;
+            if (pipeline_)
+                pipeline_->cancel();
+        };
+
+        auto simulate = [&](Workspace& workspace, Size b) {
+            Size offset = b*blockSize;
+            Size n = std::min(blockSize, samples-offset);
+            Real* c = controls ? controls+offset : 0;
+            Real* g = greeks ? greeks+3*offset : 0;
+            Real* r = ratios ? ratios+offset : 0;
+            if (options_.terminalSampling)
+                simulateTerminalBlock(workspace, firstBlock+b, n,
+                                      values+offset, weights+offset,
+                                      c, g, r);
+            else if (workspace.floatBatch)
+                simulateBatchedBlock(*workspace.floatBatch,
+                                     blockGenerator(workspace, firstBlock+b),
+                                     n, values+offset, weights+offset,
+                                     c, g);
+            else if (workspace.batch)
+                simulateBatchedBlock(*workspace.batch,
+                                     blockGenerator(workspace, firstBlock+b),
+                                     n, values+offset, weights+offset,
+                                     c, g);
+            else
+                simulateBlock(workspace, firstBlock+b, n,
+                              values+offset, weights+offset,
+                              c, g, r);
+        };
+
+        auto work = [&](Size worker) {
+            Workspace& workspace = *workspaces_[worker];
+            Size allocated = McAllocationCounter::thread();
+            try {
+                if (pipeline_) {
+                    // each worker prices the blocks its producer
+                    // draws, in the same fixed order
+                    McDrawRing& ring = pipeline_->ring(worker);
+                    for (Size b=worker; b<blocks; b+=nWorkers) {
+                        const McDrawRing::Slot* slot = ring.front();
+                        if (!slot)
+                            break;
+                        QL_ENSURE(slot->block == firstBlock+b,
+                                  "draws received for block "
+                                  << slot->block
+                                  << " instead of " << firstBlock+b);
+                        workspace.readyDraws = slot->draws;
+                        workspace.readyWeights = slot->weights;
+                        simulate(workspace, b);
+                        ring.release();
+                    }
+                } else {
+                    for (Size b = nextBlock++; b < blocks;
+                                                      b = nextBlock++) {
+                        if (options_.drawStore) {
+                            workspace.readyDraws =
+                                options_.drawStore->draws(firstBlock+b);
+                            workspace.readyWeights =
+                                options_.drawStore->weights(firstBlock+b);
+                        }
+                        simulate(workspace, b);
+                    }
+                }
+            } catch (...) {
+                fail();
+            }
+            workspace.readyDraws = workspace.readyWeights = 0;
+            allocations += McAllocationCounter::thread() - allocated;
+        };
+
+        if (pipeline_) {
+            // the producer of a ring is the only user of the
+            // generator of its workspace; see Workspace
+            auto produce = [&](McDrawRing::Slot& slot, Size b) {
+                Size allocated = McAllocationCounter::thread();
+                fillDraws(*workspaces_[b % nWorkers], slot, firstBlock+b,
+                          std::min(blockSize, samples-b*blockSize));
+                allocations += McAllocationCounter::thread() - allocated;
+            };
+            pipeline_->start(nWorkers, blocks, produce);
+        }
+        std::vector<std::thread> workers;
+        for (Size i=1; i<nWorkers; ++i)
+            workers.push_back(std::thread(work, i));
+        work(0);
+        for (Size i=0; i<workers.size(); ++i)
+            workers[i].join();
+        if (pipeline_)
+            pipeline_->join();
+        if (error)
+            std::rethrow_exception(error);
+        sampleLoopAllocations_ += allocations;
+
+        for (Size i=0; i<samples; ++i)
+            blockAccumulator_.add(values[i], weights[i]);
+        if (controls) {
+            for (Size i=0; i<samples; ++i)
+                controlStatistics_.add(values[i], controls[i], weights[i]);
+        }
+        if (greeks) {
+            for (Size i=0; i<samples; ++i)
+                for (Size k=0; k<3; ++k)
+                    greekStatistics_[k].add(greeks[3*i+k], weights[i]);
+        }
+        if (ratios) {
+            // second moment of the undistorted estimator, for
+            // comparison: E_P[v^2] = E_Q[(v L)^2 / L]
+            for (Size i=0; i<samples; ++i) {
+                importanceSquares_ += weights[i]*values[i]*values[i]/ratios[i];
+                importanceWeights_ += weights[i];
+            }
+        }
+        if (blockSums()) {
+            for (Size b=0; b<blocks; ++b) {
+                Size offset = b*blockSize;
+                shardResult_.add(firstBlock+b, values+offset,
+                                 weights+offset,
+                                 std::min(blockSize, samples-offset));
+            }
+        }
+        if (replicatedBlocks()) {
+            for (Size i=0; i<samples; ++i) {
+                Size replica = (firstBlock + i/blockSize) % blockReplicas_;
+                replicaSums_[replica] += values[i]*weights[i];
+                replicaWeights_[replica] += weights[i];
+            }
+        }
+        blockSamples_ += samples;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::fillDraws(Workspace& workspace,
+                                                     McDrawRing::Slot& slot,
+                                                     Size block,
+                                                     Size samples) const {
+        typedef typename block_generator_type::sample_type sequence_type;
+        // same draws as the block would use without the pipeline
+        const Size dimension = blockDimension();
+        block_generator_type& generator = blockGenerator(workspace, block);
+        for (Size i=0; i<samples; ++i) {
+            const sequence_type& sequence = generator.nextSequence();
+            std::copy(sequence.value.begin(), sequence.value.end(),
+                      slot.draws + i*dimension);
+            slot.weights[i] = sequence.weight;
+        }
+        slot.block = block;
+        slot.samples = samples;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::simulateBlock(
+                                                   Workspace& workspace,
+                                                   Size block,
+                                                   Size samples,
+                                                   Real* values,
+                                                   Real* weights,
+                                                   Real* controls,
+                                                   Real* greeks,
+                                                   Real* ratios) const {
+        typedef typename block_generator_type::sample_type sequence_type;
+
+        const Size dimension = blockGrid_.size()-1;
+        Path& path = *workspace.path;
+        Real* draws = workspace.draws;
+        // ready draws come from a producer thread or a draw store
+        block_generator_type* generator = 0;
+        const Real* blockDraws = 0;
+        if (workspace.readyDraws) {
+            blockDraws = workspace.readyDraws;
+            std::copy(workspace.readyWeights,
+                      workspace.readyWeights + samples, weights);
+        } else {
+            generator = &blockGenerator(workspace, block);
+            if (workspace.blockDraws) {
+                drawBlock(*generator, workspace, block, samples,
+                          dimension, weights);
+                blockDraws = workspace.blockDraws;
+            }
+        }
+
+        for (Size i=0; i<samples; ++i) {
+            const Real* z;
+            if (blockDraws) {
+                z = blockDraws + i*dimension;
+            } else {
+                const sequence_type& sequence = generator->nextSequence();
+                z = &sequence.value[0];
+                weights[i] = sequence.weight;
+            }
+            Real ratio = 1.0;
+            if (ratios) {
+                // the draws are sampled around the shift; the
+                // likelihood ratio brings the estimate back
+                Real projection = 0.0;
+                for (Size j=0; j<dimension; ++j) {
+                    workspace.shifted[j] =
+                        z[j] + importanceShift_*importanceDirection_[j];
+                    projection += importanceDirection_[j]*z[j];
+                }
+                z = workspace.shifted;
+                ratio = std::exp(-importanceShift_*
+                                 (projection + 0.5*importanceShift_));
+                ratios[i] = ratio;
+            }
+            if (this->brownianBridge_)
+                workspace.bridge->transform(z, z+dimension, draws);
+            else
+                std::copy(z, z+dimension, draws);
+            Real price = (*blockPricer_)(evolvePath(path, draws, 1.0));
+            Real control = 0.0, w = 0.0;
+            if (controls) {
+                for (Size j=0; j<controlSqrtDt_.size(); ++j)
+                    w += controlSqrtDt_[j]*draws[j];
+                control = controlValue(path.back(), w);
+            }
+            Real* g = greeks ? greeks+3*i : 0;
+            Real greekWeight = (this->antitheticVariate_ ? 0.5 : 1.0)*ratio;
+            if (g) {
+                std::fill(g, g+3, 0.0);
+                addGreeks(path.back(), greekWeight, g);
+            }
+            if (this->antitheticVariate_) {
+                price = (price +
+                         (*blockPricer_)(evolvePath(path, draws, -1.0)))/2.0;
+                if (controls)
+                    control = (control + controlValue(path.back(), -w))/2.0;
+                if (g)
+                    addGreeks(path.back(), greekWeight, g);
+            }
+            values[i] = price*ratio;
+            if (controls)
+                controls[i] = control;
+        }
+    }
+
+
+    template <class RNG, class S>
+    template <class GSG>
+    inline void MCEuropeanEngine_2<RNG,S>::drawBlock(GSG& generator,
+                                                    Workspace& workspace,
+                                                    Size block,
+                                                    Size samples,
+                                                    Size dimension,
+                                                    Real* weights) const {
+        typedef typename GSG::sample_type sequence_type;
+        Real* z = workspace.blockDraws;
+        for (Size i=0; i<samples; ++i) {
+            const sequence_type& sequence = generator.nextSequence();
+            std::copy(sequence.value.begin(), sequence.value.end(),
+                      z + i*dimension);
+            weights[i] = sequence.weight;
+        }
+
+        Size stratified = 0;
+        if (options_.sampling == EuropeanSampling_2::Stratified)
+            stratified = 1;
+        else if (options_.sampling == EuropeanSampling_2::LatinHypercube)
+            stratified = dimension;
+        if (stratified > 0) {
+            // each draw is moved into its stratum, keeping its
+            // relative position; strata are shuffled independently
+            // for each dimension but the first one, which is the
+            // terminal variate under Brownian-bridge construction
+            CumulativeNormalDistribution phi;
+            InverseCumulativeNormal phiInverse;
+            MersenneTwisterUniformRng_2& shuffler = workspace.shuffler;
+            shuffler.reseed(
+                detail::mcBlockSeed(detail::mcBlockSeed(blockSeed_, block),
+                                    0));
+            Size* strata = workspace.strata;
+            for (Size d=0; d<stratified; ++d) {
+                for (Size i=0; i<samples; ++i)
+                    strata[i] = i;
+                if (d > 0) {
+                    for (Size i=samples-1; i>0; --i)
+                        std::swap(strata[i],
+                                  strata[shuffler.nextInt32() % (i+1)]);
+                }
+                for (Size i=0; i<samples; ++i) {
+                    Real u = std::min(std::max(phi(z[i*dimension+d]),
+                                               QL_EPSILON),
+                                      1.0-QL_EPSILON);
+                    z[i*dimension+d] = phiInverse((strata[i] + u)/samples);
+                }
+            }
+        }
+
+        if (options_.momentMatching && samples > 1) {
+            // sample mean and variance of each variate set to 0 and 1
+            for (Size d=0; d<dimension; ++d) {
+                Real sum = 0.0, sum2 = 0.0;
+                for (Size i=0; i<samples; ++i) {
+                    Real x = z[i*dimension+d];
+                    sum += x;
+                    sum2 += x*x;
+                }
+                Real mean = sum/samples;
+                Real variance = (sum2 - sum*mean)/(samples-1);
+                if (variance <= 0.0)
+                    continue;
+                Real scale = 1.0/std::sqrt(variance);
+                for (Size i=0; i<samples; ++i)
+                    z[i*dimension+d] = (z[i*dimension+d] - mean)*scale;
+            }
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline const Path& MCEuropeanEngine_2<RNG,S>::evolvePath(
+                                                      Path& path,
+                                                      const Real* draws,
+                                                      Real sign) const {
+        // same as PathGenerator::next, on a path owned by the caller
+        const StochasticProcess1D& process = *blockProcess_;
+        path.front() = process.x0();
+        for (Size i=1; i<path.length(); ++i) {
+            Time t = blockGrid_[i-1], dt = blockGrid_.dt(i-1);
+            path[i] = process.evolve(t, path[i-1], dt, sign*draws[i-1]);
+        }
+        return path;
+    }
+
+
+    template <class RNG, class S>
+    inline bool MCEuropeanEngine_2<RNG,S>::exactLogNormal() const {
+        if (options_.constantParameters)
+            return true;
+        return detail::hasExactLogNormalTransition(this->process_);
+    }
+
+
+    template <class RNG, class S>
+    template <class T>
+    inline void MCEuropeanEngine_2<RNG,S>::simulateBatchedBlock(
+                                            BatchPathGenerator<T>& paths,
+                                            block_generator_type& generator,
+                                            Size samples,
+                                                Real* values,
+                                                Real* weights,
+                                                Real* controls,
+                                                Real* greeks) const {
+        Size steps = paths.timeSteps();
+        Real greekWeight = this->antitheticVariate_ ? 0.5 : 1.0;
+        const EuropeanPathPricer_2& pricer = *europeanPricer_;
+
+        for (Size i=0; i<samples; i+=paths.paths()) {
+            paths.next(generator, std::min(paths.batchSize(), samples-i));
+            Size n = paths.paths();
+            for (Size j=0; j<n; ++j) {
+                values[i+j] = pricer(paths.value(steps, j));
+                weights[i+j] = paths.weight(j);
+            }
+            if (greeks) {
+                std::fill(greeks+3*i, greeks+3*(i+n), 0.0);
+                for (Size j=0; j<n; ++j)
+                    addGreeks(paths.value(steps, j), greekWeight,
+                              greeks+3*(i+j));
+            }
+            if (controls) {
+                // the Brownian motion at maturity, reused by the
+                // antithetic path with opposite sign
+                std::fill(controls+i, controls+i+n, 0.0);
+                for (Size k=0; k<steps; ++k) {
+                    const T* z = paths.draws(k);
+                    for (Size j=0; j<n; ++j)
+                        controls[i+j] += controlSqrtDt_[k]*z[j];
+                }
+                for (Size j=0; j<n; ++j) {
+                    Real w = controls[i+j];
+                    controls[i+j] = controlValue(paths.value(steps, j), w);
+                }
+            }
+            if (this->antitheticVariate_) {
+                paths.antithetic();
+                for (Size j=0; j<n; ++j)
+                    values[i+j] = (values[i+j] +
+                                   pricer(paths.value(steps, j)))/2.0;
+                if (greeks) {
+                    for (Size j=0; j<n; ++j)
+                        addGreeks(paths.value(steps, j), greekWeight,
+                                  greeks+3*(i+j));
+                }
+                if (controls) {
+                    for (Size j=0; j<n; ++j) {
+                        Real w = 0.0;
+                        for (Size k=0; k<steps; ++k)
+                            w += controlSqrtDt_[k]*paths.draws(k)[j];
+                        controls[i+j] = (controls[i+j] +
+                                         controlValue(paths.value(steps, j),
+                                                      -w))/2.0;
+                    }
+                }
+            }
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setupTerminalSampling() const {
+        QL_REQUIRE(exactLogNormal(),
+                   "terminal sampling requires a log-normal process with "
+                   "strike-independent volatility");
+
+        Time maturity = blockGrid_.back();
+
+        if (options_.constantParameters) {
+            // exact by construction
+            terminalSpot_ = blockProcess_->x0();
+            terminalDrift_ = blockProcess_->drift(0.0, terminalSpot_)*maturity;
+            terminalStdDev_ =
+                blockProcess_->stdDeviation(0.0, terminalSpot_, maturity);
+            return;
+        }
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        boost::shared_ptr<BlackVolTermStructure> vol =
+            process->blackVolatility().currentLink();
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        // log-normal law of the underlying at maturity
+        Real variance = vol->blackVariance(maturity, payoff->strike());
+        terminalSpot_ = process->x0();
+        terminalDrift_ =
+            std::log(process->dividendYield()->discount(maturity) /
+                     process->riskFreeRate()->discount(maturity))
+            - 0.5*variance;
+        terminalStdDev_ = std::sqrt(variance);
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::simulateTerminalBlock(
+                                                        Workspace& workspace,
+                                                        Size block,
+                                                        Size samples,
+                                                        Real* values,
+                                                        Real* weights,
+                                                        Real* controls,
+                                                        Real* greeks,
+                                                        Real* ratios) const {
+        typedef typename block_generator_type::sample_type sample_type;
+        Real greekWeight = this->antitheticVariate_ ? 0.5 : 1.0;
+
+        const EuropeanPathPricer_2& pricer = *europeanPricer_;
+
+        block_generator_type* generator = 0;
+        const Real* blockDraws = 0;
+        Real drift = terminalDrift_;
+        if (workspace.readyDraws) {
+            blockDraws = workspace.readyDraws;
+            std::copy(workspace.readyWeights,
+                      workspace.readyWeights + samples, weights);
+        } else {
+            generator = &blockGenerator(workspace, block);
+        }
+        if (workspace.blockDraws) {
+            drawBlock(*generator, workspace, block, samples, 1, weights);
+            blockDraws = workspace.blockDraws;
+            if (options_.momentMatching) {
+                // values at maturity are rescaled so that their
+                // average is the exact forward
+                Real sum = 0.0;
+                for (Size i=0; i<samples; ++i) {
+                    Real w = terminalStdDev_*blockDraws[i];
+                    sum += std::exp(w);
+                    if (this->antitheticVariate_)
+                        sum += std::exp(-w);
+                }
+                Real average =
+                    sum / (this->antitheticVariate_ ? 2*samples : samples);
+                drift += 0.5*terminalStdDev_*terminalStdDev_
+                       - std::log(average);
+            }
+        }
+
+        for (Size i=0; i<samples; ++i) {
+            Real z;
+            if (blockDraws) {
+                z = blockDraws[i];
+            } else {
+                const sample_type& sequence = generator->nextSequence();
+                z = sequence.value[0];
+                weights[i] = sequence.weight;
+            }
+            Real ratio = 1.0;
+            if (ratios) {
+                ratio = std::exp(-importanceShift_*
+                                 (z + 0.5*importanceShift_));
+                ratios[i] = ratio;
+                z += importanceShift_;
+            }
+            Real w = terminalStdDev_*z;
+            Real underlying = terminalSpot_*std::exp(drift+w);
+            Real price = pricer(underlying);
+            Real control = 0.0, bm = 0.0;
+            if (controls) {
+                bm = controlSqrtDt_.back()*z;
+                control = controlValue(underlying, bm);
+            }
+            Real* g = greeks ? greeks+3*i : 0;
+            if (g) {
+                std::fill(g, g+3, 0.0);
+                addGreeks(underlying, greekWeight*ratio, g);
+            }
+            if (this->antitheticVariate_) {
+                underlying = terminalSpot_*std::exp(drift-w);
+                price = (price + pricer(underlying))/2.0;
+                if (controls)
+                    control = (control + controlValue(underlying, -bm))/2.0;
+                if (g)
+                    addGreeks(underlying, greekWeight, g);
+            }
+            values[i] = price*ratio;
+            if (controls)
+                controls[i] = control;
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setupControlVariate() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = blockGrid_.back();
+        DiscountFactor riskFreeDiscount =
+            process->riskFreeRate()->discount(maturity);
+        DiscountFactor dividendDiscount =
+            process->dividendYield()->discount(maturity);
+        controlDiscount_ = riskFreeDiscount;
+
+        switch (options_.controlVariate) {
+          case EuropeanControlVariate_2::AnalyticPrice:
+            {
+                boost::shared_ptr<ConstantBlackScholesProcess> bs =
+                    constantProcess();
+                controlSpot_ = bs->x0();
+                controlDrift_ = bs->drift(0.0, controlSpot_)*maturity;
+                controlVolatility_ = bs->volatility();
+                BlackCalculator black(payoff,
+                                      controlSpot_*dividendDiscount/
+                                                    riskFreeDiscount,
+                                      controlVolatility_*std::sqrt(maturity),
+                                      riskFreeDiscount);
+                controlMean_ = black.value();
+            }
+            break;
+          case EuropeanControlVariate_2::DiscountedUnderlying:
+            controlMean_ = process->x0()*dividendDiscount;
+            break;
+          default:
+            QL_FAIL("unknown control variate");
+        }
+
+        // the Brownian motion at maturity is rebuilt from the
+        // normalized draws of each step
+        if (options_.terminalSampling) {
+            controlSqrtDt_.assign(1, std::sqrt(maturity));
+        } else {
+            controlSqrtDt_.resize(blockGrid_.size()-1);
+            for (Size i=0; i<controlSqrtDt_.size(); ++i)
+                controlSqrtDt_[i] = std::sqrt(blockGrid_.dt(i));
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCEuropeanEngine_2<RNG,S>::controlValue(
+                                               Real underlying,
+                                               Real brownianValue) const {
+        if (options_.controlVariate == EuropeanControlVariate_2::AnalyticPrice)
+            return (*europeanPricer_)(
+                      controlSpot_*std::exp(controlDrift_ +
+                                            controlVolatility_*brownianValue));
+        else
+            return controlDiscount_*underlying;
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setupGreeks() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = blockGrid_.back();
+        Real variance = process->blackVolatility()->blackVariance(
+                                                maturity, payoff->strike());
+        QL_REQUIRE(variance > 0.0, "null volatility given");
+        DiscountFactor riskFreeDiscount =
+            process->riskFreeRate()->discount(maturity);
+        DiscountFactor dividendDiscount =
+            process->dividendYield()->discount(maturity);
+
+        greekSpot_ = process->x0();
+        greekStrike_ = payoff->strike();
+        greekSign_ = (payoff->optionType() == Option::Call ? 1.0 : -1.0);
+        greekDiscount_ = riskFreeDiscount;
+        greekDrift_ = std::log(dividendDiscount/riskFreeDiscount)
+                    - 0.5*variance;
+        greekStdDev_ = std::sqrt(variance);
+        greekSqrtT_ = std::sqrt(maturity);
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::addGreeks(Real underlying,
+                                                     Real weight,
+                                                     Real* greeks) const {
+        if (greekSign_*(underlying - greekStrike_) <= 0.0)
+            return;
+        // discounted derivative of the payoff times S_T
+        Real dPayoff = weight*greekSign_*greekDiscount_*underlying;
+        Real z = (std::log(underlying/greekSpot_) - greekDrift_)
+               / greekStdDev_;
+        greeks[0] += dPayoff/greekSpot_;
+        greeks[1] += dPayoff/(greekSpot_*greekSpot_)
+                   * (z/greekStdDev_ - 1.0);
+        greeks[2] += dPayoff*greekSqrtT_*(z - greekStdDev_);
+    }
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::setupImportanceSampling() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = blockGrid_.back();
+        Real strike = payoff->strike();
+        Real variance =
+            process->blackVolatility()->blackVariance(maturity, strike);
+        QL_REQUIRE(variance > 0.0, "null volatility given");
+        Real spot = process->x0();
+        Real drift = std::log(process->dividendYield()->discount(maturity) /
+                              process->riskFreeRate()->discount(maturity))
+                   - 0.5*variance;
+        Real stdDev = std::sqrt(variance);
+
+        // The normalized terminal variate is shifted to the mode of
+        // payoff(S_T(z))*phi(z), where the zero-variance density peaks
+        // under the lognormal approximation of the process; for both
+        // calls and puts, it is the root of z = sigma*S/(S-K) on the
+        // in-the-money side of the strike.
+        Real sign = (payoff->optionType() == Option::Call ? 1.0 : -1.0);
+        Real strikeVariate = (std::log(strike/spot) - drift)/stdDev;
+        auto f = [&](Real z) {
+            Real underlying = spot*std::exp(drift+stdDev*z);
+            return z - stdDev*underlying/(underlying-strike);
+        };
+        // f goes from -sign*infinity at the strike to sign*infinity
+        Real inner = strikeVariate, outer = strikeVariate + sign;
+        while (sign*f(outer) <= 0.0)
+            outer += 2.0*(outer-inner);
+        for (Size i=0; i<100; ++i) {
+            Real middle = 0.5*(inner+outer);
+            if (sign*f(middle) > 0.0)
+                outer = middle;
+            else
+                inner = middle;
+        }
+        importanceShift_ = 0.5*(inner+outer);
+
+        // unit vector along which the draws are shifted, so that the
+        // Brownian motion at maturity moves by the shift times sqrt(T)
+        if (options_.terminalSampling) {
+            importanceDirection_.assign(1, 1.0);
+        } else if (this->brownianBridge_) {
+            // the first bridge variate drives the terminal value
+            importanceDirection_.assign(blockGrid_.size()-1, 0.0);
+            importanceDirection_[0] = 1.0;
+        } else {
+            importanceDirection_.resize(blockGrid_.size()-1);
+            for (Size i=0; i<importanceDirection_.size(); ++i)
+                importanceDirection_[i] =
+                    std::sqrt(blockGrid_.dt(i)/maturity);
+        }
+    }
 
 
     template <class RNG, class S>
@@ -153,13 +2187,93 @@ namespace QuantLib {
     }
 
 
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::pathGenerator() const {
+
+        if (!options_.constantParameters && !options_.gridParameters)
+            return MCVanillaEngine<SingleVariate,RNG,S>::pathGenerator();
+
+        TimeGrid grid = this->timeGrid();
+        typename RNG::rsg_type generator =
+            RNG::make_sequence_generator(grid.size()-1, this->seed_);
+        boost::shared_ptr<StochasticProcess1D> process;
+        if (options_.constantParameters)
+            process = constantProcess();
+        else
+            process = gridProcess();
+        return boost::shared_ptr<path_generator_type>(
+                   new path_generator_type(process, grid,
+                                           generator, this->brownianBridge_));
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<StochasticProcess1D>
+    MCEuropeanEngine_2<RNG,S>::makeBlockProcess() const {
+        if (options_.constantParameters)
+            return constantProcess();
+        else if (options_.gridParameters)
+            return gridProcess();
+        else
+            return boost::dynamic_pointer_cast<StochasticProcess1D>(
+                                                            this->process_);
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<ConstantBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::constantProcess() const {
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        // parameters are taken at maturity so that the terminal
+        // distribution is the same as the one of the original process
+        Time maturity = this->timeGrid().back();
+        Rate r = process->riskFreeRate()->zeroRate(maturity, Continuous,
+                                                   NoFrequency);
+        Rate q = process->dividendYield()->zeroRate(maturity, Continuous,
+                                                    NoFrequency);
+        Volatility sigma =
+            process->blackVolatility()->blackVol(maturity, payoff->strike());
+
+        return boost::shared_ptr<ConstantBlackScholesProcess>(
+                  new ConstantBlackScholesProcess(process->x0(), q, r, sigma));
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<GridBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::gridProcess() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+        return boost::shared_ptr<GridBlackScholesProcess>(
+                  new GridBlackScholesProcess(process, this->timeGrid()));
+    }
+
+
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>::MakeMCEuropeanEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
     : process_(process), antithetic_(false),
       steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
       samples_(Null<Size>()), maxSamples_(Null<Size>()),
-      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0) {}
+      tolerance_(Null<Real>()), brownianBridge_(false), seed_(0) {
+        // Brownian-bridge construction is what makes randomized
+        // quasi-random sequences effective on multi-step paths
+        brownianBridge_ = (detail::McBlockSequence<RNG>::replicated != 0);
+    }
 
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>&
@@ -189,7 +2303,8 @@ namespace QuantLib {
     MakeMCEuropeanEngine_2<RNG,S>::withAbsoluteTolerance(Real tolerance) {
         QL_REQUIRE(samples_ == Null<Size>(),
                    "number of samples already set");
-        QL_REQUIRE(RNG::allowsErrorEstimate,
+        QL_REQUIRE(RNG::allowsErrorEstimate ||
+                   detail::McBlockSequence<RNG>::replicated,
                    "chosen random generator policy "
                    "does not allow an error estimate");
         tolerance_ = tolerance;
@@ -224,23 +2339,175 @@ namespace QuantLib {
         return *this;
     }
 
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withThreads(Size n) {
+        QL_REQUIRE(n > 0, "at least one thread required");
+        options_.threads = n;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withTerminalSampling(bool b) {
+        options_.terminalSampling = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withConstantParameters(bool b) {
+        options_.constantParameters = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withGridParameters(bool b) {
+        options_.gridParameters = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withPathBatches(Size batchSize) {
+        QL_REQUIRE(batchSize > 0, "null path-batch size given");
+        options_.pathBatchSize = batchSize;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withSinglePrecision(bool b) {
+        options_.singlePrecision = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withControlVariate(
+                                      EuropeanControlVariate_2::Type type) {
+        options_.controlVariate = type;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withReplicas(Size replicas) {
+        QL_REQUIRE(replicas > 1, "at least two replicas required");
+        options_.replicas = replicas;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    template <class Rep, class Period>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withTimeBudget(
+                          const std::chrono::duration<Rep,Period>& budget) {
+        Real seconds = std::chrono::duration<Real>(budget).count();
+        QL_REQUIRE(seconds > 0.0, "positive time budget required");
+        options_.timeBudget = seconds;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withProgressCallback(
+                             const MonteCarloProgressCallback_2& callback) {
+        options_.progress = callback;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withGreeks(bool b) {
+        options_.greeks = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withSampling(
+                                           EuropeanSampling_2::Type type) {
+        options_.sampling = type;
+        // under Brownian-bridge construction, the first variate is
+        // the one driving the value at maturity
+        if (type == EuropeanSampling_2::Stratified)
+            brownianBridge_ = true;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withMomentMatching(bool b) {
+        options_.momentMatching = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withImportanceSampling(bool b) {
+        options_.importanceSampling = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withDrawPipeline(bool b) {
+        options_.drawPipeline = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withDrawStore(
+                          const boost::shared_ptr<const McDrawStore>& store) {
+        options_.drawStore = store;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withShard(Size shard, Size shards) {
+        options_.shard = shard;
+        options_.shards = shards;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withCheckpoint(const std::string& fileName,
+                                                  Real interval) {
+        options_.checkpointFile = fileName;
+        options_.checkpointInterval = interval;
+        return *this;
+    }
+
     template <class RNG, class S>
     inline
     MakeMCEuropeanEngine_2<RNG,S>::operator boost::shared_ptr<PricingEngine>()
                                                                       const {
+        return makeEngine<MCEuropeanEngine_2<RNG,S> >();
+    }
+
+    template <class RNG, class S>
+    template <class Engine>
+    inline boost::shared_ptr<PricingEngine>
+    MakeMCEuropeanEngine_2<RNG,S>::makeEngine() const {
         QL_REQUIRE(steps_ != Null<Size>() || stepsPerYear_ != Null<Size>(),
                    "number of steps not given");
         QL_REQUIRE(steps_ == Null<Size>() || stepsPerYear_ == Null<Size>(),
                    "number of steps overspecified");
         return boost::shared_ptr<PricingEngine>(new
-            MCEuropeanEngine_2<RNG,S>(process_,
-                                      steps_,
-                                      stepsPerYear_,
-                                      brownianBridge_,
-                                      antithetic_,
-                                      samples_, tolerance_,
-                                      maxSamples_,
-                                      seed_));
+            Engine(process_,
+                   steps_,
+                   stepsPerYear_,
+                   brownianBridge_,
+                   antithetic_,
+                   samples_, tolerance_,
+                   maxSamples_,
+                   seed_,
+                   options_));
     }
 
 
@@ -258,6 +2525,10 @@ namespace QuantLib {
         return payoff_(path.back()) * discount_;
     }
 
+    inline Real EuropeanPathPricer_2::operator()(Real underlying) const {
+        return payoff_(underlying) * discount_;
+    }
+
 }
 
 
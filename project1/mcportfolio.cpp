@@ -0,0 +1,196 @@
+
+#include "mcportfolio.hpp"
+#include "mceuropeanengine.hpp"
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace QuantLib {
+
+    namespace {
+
+        Size roundUp(Size samples, Size unit) {
+            return (samples + unit-1)/unit*unit;
+        }
+
+    }
+
+    MonteCarloPortfolio_2::MonteCarloPortfolio_2(Size pilotSamples)
+    : pilotSamples_(pilotSamples), simulated_(false) {
+        QL_REQUIRE(pilotSamples > 1, "at least two pilot samples required");
+    }
+
+    Size MonteCarloPortfolio_2::add(
+                          const boost::shared_ptr<Instrument>& instrument,
+                          Real quantity,
+                          const EngineFactory& engine,
+                          Size sampleUnit) {
+        QL_REQUIRE(instrument, "null instrument given");
+        QL_REQUIRE(engine, "null engine factory given");
+        QL_REQUIRE(sampleUnit != 0, "null sample unit given");
+        Position p;
+        p.instrument = instrument;
+        p.quantity = quantity;
+        p.engine = engine;
+        p.unit = (sampleUnit != Null<Size>() ? sampleUnit :
+                                               detail::mcSamplesPerBlock);
+        p.value = p.error = p.time = 0.0;
+        p.samples = p.extra = 0;
+        positions_.push_back(p);
+        simulated_ = false;
+        return positions_.size()-1;
+    }
+
+    void MonteCarloPortfolio_2::simulate(Real timeBudget, BigNatural seed) {
+        QL_REQUIRE(!positions_.empty(), "empty portfolio");
+        QL_REQUIRE(timeBudget > 0.0, "positive time budget required");
+        if (seed == 0)
+            seed = SeedGenerator::instance().get();
+        Size n = positions_.size();
+
+        // setup and pilot runs
+        Real spent = 0.0;
+        std::vector<Real> weights(n), costs(n);
+        std::vector<Size> pilots(n);
+        for (Size i=0; i<n; ++i) {
+            Position& p = positions_[i];
+            p.value = p.error = p.time = 0.0;
+            p.samples = p.extra = 0;
+            Real setupTime, pilotTime;
+            run(p, roundUp(2, p.unit), detail::mcBlockSeed(seed, 3*i),
+                setupTime);
+            Real pilotError = 0.0;
+            pilots[i] = run(p, roundUp(pilotSamples_, p.unit),
+                            detail::mcBlockSeed(seed, 3*i+1), pilotTime,
+                            &pilotError);
+            spent += setupTime + pilotTime;
+            Real sigma = pilotError*std::sqrt(Real(pilots[i]));
+            costs[i] = std::max<Real>(pilotTime/pilots[i],
+                                      std::numeric_limits<Real>::min());
+            weights[i] = std::fabs(p.quantity)*sigma/std::sqrt(costs[i]);
+        }
+
+        // the rest of the budget, where it reduces the error most
+        std::vector<Size> extra = allocate(weights, costs, pilots,
+                                           timeBudget - spent);
+        for (Size i=0; i<n; ++i) {
+            if (extra[i] == 0)
+                continue;
+            Position& p = positions_[i];
+            Real time;
+            p.extra = run(p, extra[i], detail::mcBlockSeed(seed, 3*i+2),
+                          time);
+        }
+        simulated_ = true;
+    }
+
+    Size MonteCarloPortfolio_2::run(Position& p,
+                                    Size samples,
+                                    BigNatural seed,
+                                    Real& time,
+                                    Real* error) const {
+        p.instrument->setPricingEngine(p.engine(samples, seed));
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        Real value = p.instrument->NPV();
+        Real e = p.instrument->errorEstimate();
+        time = std::chrono::duration<Real>(
+                   std::chrono::steady_clock::now() - start).count();
+        const std::map<std::string,boost::any>& results =
+            p.instrument->additionalResults();
+        std::map<std::string,boost::any>::const_iterator i =
+            results.find("samples");
+        if (i != results.end())
+            samples = boost::any_cast<Size>(i->second);
+
+        // independent estimates, weighted by their samples
+        Real n0 = Real(p.samples), n1 = Real(samples);
+        p.value = (n0*p.value + n1*value)/(n0+n1);
+        p.error = std::sqrt(n0*n0*p.error*p.error + n1*n1*e*e)/(n0+n1);
+        p.samples += samples;
+        p.time += time;
+        if (error)
+            *error = e;
+        return samples;
+    }
+
+    std::vector<Size> MonteCarloPortfolio_2::allocate(
+                                          const std::vector<Real>& weights,
+                                          const std::vector<Real>& costs,
+                                          const std::vector<Size>& pilots,
+                                          Real budget) const {
+        // position i gets max(lambda*weights[i] - pilots[i], 0) samples
+        // in total; lambda is set so that their cost exhausts the
+        // budget.  Positions join in the order of the lambda at which
+        // they start getting samples.
+        Size n = weights.size();
+        std::vector<Size> extra(n, 0);
+        if (budget <= 0.0)
+            return extra;
+        std::vector<std::pair<Real,Size> > thresholds;
+        for (Size i=0; i<n; ++i)
+            if (weights[i] > 0.0)
+                thresholds.push_back(
+                    std::make_pair(Real(pilots[i])/weights[i], i));
+        if (thresholds.empty())
+            return extra;
+        std::sort(thresholds.begin(), thresholds.end());
+
+        Real lambda = 0.0, slope = 0.0, offset = budget;
+        for (Size k=0; k<thresholds.size(); ++k) {
+            Size i = thresholds[k].second;
+            slope += costs[i]*weights[i];
+            offset += costs[i]*pilots[i];
+            lambda = offset/slope;
+            if (k+1 == thresholds.size() || lambda <= thresholds[k+1].first)
+                break;
+        }
+        // whole units, which engines would simulate anyway
+        for (Size i=0; i<n; ++i) {
+            Real samples = lambda*weights[i] - pilots[i];
+            if (samples >= 1.0)
+                extra[i] = roundUp(Size(std::ceil(samples)),
+                                   positions_[i].unit);
+        }
+        return extra;
+    }
+
+    const MonteCarloPortfolio_2::Position&
+    MonteCarloPortfolio_2::position(Size i) const {
+        QL_REQUIRE(simulated_, "portfolio not simulated");
+        QL_REQUIRE(i < positions_.size(),
+                   "position " << i << " out of " << positions_.size());
+        return positions_[i];
+    }
+
+    Real MonteCarloPortfolio_2::value() const {
+        Real result = 0.0;
+        for (Size i=0; i<size(); ++i)
+            result += position(i).quantity*position(i).value;
+        return result;
+    }
+
+    Real MonteCarloPortfolio_2::errorEstimate() const {
+        // positions are priced from independent seeds
+        Real result = 0.0;
+        for (Size i=0; i<size(); ++i) {
+            Real e = position(i).quantity*position(i).error;
+            result += e*e;
+        }
+        return std::sqrt(result);
+    }
+
+    Real MonteCarloPortfolio_2::time() const {
+        Real result = 0.0;
+        for (Size i=0; i<size(); ++i)
+            result += position(i).time;
+        return result;
+    }
+
+}
+
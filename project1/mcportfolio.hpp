@@ -0,0 +1,124 @@
+/*! \file mcportfolio.hpp
+    \brief Monte Carlo valuation of a portfolio within a time budget
+*/
+
+#ifndef mc_portfolio_hpp
+#define mc_portfolio_hpp
+
+#include <ql/instrument.hpp>
+#include <ql/pricingengine.hpp>
+#include <ql/utilities/null.hpp>
+#include <boost/noncopyable.hpp>
+#include <functional>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Monte Carlo valuation of a portfolio within a time budget
+    /*! Each position is an instrument, a quantity, and a function
+        returning a Monte Carlo engine (e.g., built by
+        MakeMCEuropeanEngine_2) that draws a given number of samples
+        from a given seed.
+
+        simulate() first prices each instrument with a single unit of
+        samples (see add()), or two if the unit is a single sample;
+        this keeps the setup done by the first valuation, such as
+        building term structures, out of the timings below.  It then
+        prices every instrument with the same number of pilot
+        samples, and estimates from these the variance
+        \f$ \sigma_i^2 \f$ of a sample (from the error estimate of the
+        engine) and its cost \f$ c_i \f$ (the wall-clock time of the
+        run, divided by the number of samples).  The number of
+        samples of a run is the one returned by the engine as the
+        "samples" additional result, which may differ from the
+        required one; the required one is used if the engine returns
+        none.  The rest of the budget is then allocated as in
+        M. Giles' multilevel Monte Carlo: the standard error
+        \f$ \sqrt{\sum_i q_i^2 \sigma_i^2/n_i} \f$ of the portfolio
+        value, with quantities \f$ q_i \f$, is smallest for a given
+        total cost \f$ \sum_i c_i n_i \f$ when \f$ n_i \f$ is
+        proportional to \f$ |q_i| \sigma_i/\sqrt{c_i} \f$.  Positions
+        whose share is below the pilot samples are not simulated
+        further.
+
+        Sample counts are rounded up to whole units of the position,
+        by default blocks of detail::mcSamplesPerBlock samples, which
+        MCEuropeanEngine_2 would simulate anyway in block mode.  The
+        setup, pilot and additional samples of each instrument are
+        drawn from different seeds; their estimates are combined,
+        weighted by the number of samples, so that no sample is
+        wasted.  Positions are priced in turn; each engine may use
+        several threads.  The actual time spent may differ from the
+        budget to the extent that the pilot costs mispredict the
+        final ones.
+
+        The instruments are left with the engine of their last run,
+        so the value and error of each position must be read from
+        this class.
+    */
+    class MonteCarloPortfolio_2 : private boost::noncopyable {
+      public:
+        /*! returns an engine drawing the given number of samples
+            from the given seed */
+        typedef std::function<boost::shared_ptr<PricingEngine>(
+                                                  Size samples,
+                                                  BigNatural seed)>
+            EngineFactory;
+        explicit MonteCarloPortfolio_2(Size pilotSamples = 4096);
+        //! adds a position and returns its index
+        /*! The engine is always asked for a multiple of the given
+            unit of samples; engines dealing blocks to replicas, for
+            instance, need the block size times the number of
+            replicas.  By default, the unit is a block.
+        */
+        Size add(const boost::shared_ptr<Instrument>& instrument,
+                 Real quantity,
+                 const EngineFactory& engine,
+                 Size sampleUnit = Null<Size>());
+        //! prices the portfolio within the given time, in seconds
+        void simulate(Real timeBudget, BigNatural seed = 0);
+        //! \name Inspectors
+        //@{
+        Size size() const { return positions_.size(); }
+        //! portfolio value, i.e., sum of quantities times values
+        Real value() const;
+        //! standard error of the portfolio value
+        Real errorEstimate() const;
+        //! total wall-clock time spent simulating, in seconds
+        Real time() const;
+        //! value of a unit of the given instrument
+        Real value(Size i) const { return position(i).value; }
+        Real errorEstimate(Size i) const { return position(i).error; }
+        Size samples(Size i) const { return position(i).samples; }
+        Real time(Size i) const { return position(i).time; }
+        //! samples allocated after the pilot run
+        Size extraSamples(Size i) const { return position(i).extra; }
+        //@}
+      private:
+        struct Position {
+            boost::shared_ptr<Instrument> instrument;
+            Real quantity;
+            EngineFactory engine;
+            Size unit;
+            Real value, error, time;
+            Size samples, extra;
+        };
+        const Position& position(Size i) const;
+        // runs the given samples of a position and adds the estimate
+        // to it; returns the samples actually drawn, and sets the
+        // time and, if given, the error of the run
+        Size run(Position& p, Size samples, BigNatural seed,
+                 Real& time, Real* error = 0) const;
+        std::vector<Size> allocate(const std::vector<Real>& weights,
+                                   const std::vector<Real>& costs,
+                                   const std::vector<Size>& pilots,
+                                   Real budget) const;
+        Size pilotSamples_;
+        std::vector<Position> positions_;
+        bool simulated_;
+    };
+
+}
+
+
+#endif
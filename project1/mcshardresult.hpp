@@ -0,0 +1,276 @@
+/*! \file mcshardresult.hpp
+    \brief Mergeable per-block sums of a sharded Monte Carlo run
+*/
+
+#ifndef mc_shard_result_hpp
+#define mc_shard_result_hpp
+
+#include <ql/errors.hpp>
+#include <ql/types.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Per-block sums of the samples of a Monte Carlo run
+    /*! A run split in shards, each simulating a disjoint range of
+        blocks of samples, returns one of these per shard; merging
+        them gives back the sums of the whole run.  The statistics
+        are always computed by adding the block sums in block order,
+        so that they don't depend on how the run was split, on the
+        order of the merges, or on the number of threads: a run in a
+        single shard and the merge of any number of shards give the
+        same results, bit for bit.
+
+        With replicas, blocks are dealt to them in round-robin order
+        and the error estimate is the standard error of the replica
+        means, as in MCEuropeanEngine_2.
+
+        Each result records the seed, the total number of samples
+        and the dimension of its run, as McCheckpointFile does, so
+        that shards of different runs are not merged.  A result built
+        by the default constructor describes no run yet and takes the
+        description of the first shard merged into it.
+
+        Results can be saved to and loaded from text files; values
+        are written with enough digits to be read back exactly.
+    */
+    class McShardResult {
+      public:
+        struct Block {
+            Size index, samples;
+            Real weightSum, valueSum, squareSum;
+            bool operator<(const Block& other) const {
+                return index < other.index;
+            }
+        };
+        McShardResult()
+        : replicas_(1), seed_(0), totalSamples_(0), dimension_(0) {}
+        McShardResult(Size replicas,
+                      BigNatural seed,
+                      Size totalSamples,
+                      Size dimension)
+        : replicas_(replicas), seed_(seed), totalSamples_(totalSamples),
+          dimension_(dimension) {
+            QL_REQUIRE(replicas > 0, "at least one replica required");
+            QL_REQUIRE(seed != 0, "null seed given");
+            QL_REQUIRE(totalSamples > 0, "null number of samples given");
+            QL_REQUIRE(dimension > 0, "null dimension given");
+        }
+        //! \name Inspectors
+        //@{
+        Size replicas() const { return replicas_; }
+        //! seed of the run; null if no run is described
+        BigNatural seed() const { return seed_; }
+        //! samples of the whole run, not only of this shard
+        Size totalSamples() const { return totalSamples_; }
+        //! Gaussian variates per sample
+        Size dimension() const { return dimension_; }
+        const std::vector<Block>& blocks() const { return blocks_; }
+        Size samples() const {
+            Size n = 0;
+            for (Size i=0; i<blocks_.size(); ++i)
+                n += blocks_[i].samples;
+            return n;
+        }
+        Real mean() const {
+            Real weights = 0.0, values = 0.0;
+            for (Size i=0; i<blocks_.size(); ++i) {
+                weights += blocks_[i].weightSum;
+                values += blocks_[i].valueSum;
+            }
+            QL_REQUIRE(weights > 0.0, "empty shard result");
+            return values/weights;
+        }
+        Real variance() const {
+            Real weights = 0.0, values = 0.0, squares = 0.0;
+            Size n = 0;
+            for (Size i=0; i<blocks_.size(); ++i) {
+                weights += blocks_[i].weightSum;
+                values += blocks_[i].valueSum;
+                squares += blocks_[i].squareSum;
+                n += blocks_[i].samples;
+            }
+            QL_REQUIRE(n > 1, "sample number <= 1, unsufficient");
+            Real m = values/weights;
+            return std::max<Real>(squares/weights - m*m, 0.0)
+                 * n/(n-1.0);
+        }
+        Real errorEstimate() const {
+            if (replicas_ == 1)
+                return std::sqrt(variance()/samples());
+
+            std::vector<Real> weights(replicas_, 0.0),
+                              values(replicas_, 0.0);
+            for (Size i=0; i<blocks_.size(); ++i) {
+                Size r = blocks_[i].index % replicas_;
+                weights[r] += blocks_[i].weightSum;
+                values[r] += blocks_[i].valueSum;
+            }
+            Real sum = 0.0;
+            for (Size r=0; r<replicas_; ++r) {
+                QL_REQUIRE(weights[r] > 0.0, "empty replica");
+                sum += values[r]/weights[r];
+            }
+            Real m = sum/replicas_, deviations = 0.0;
+            for (Size r=0; r<replicas_; ++r) {
+                Real d = values[r]/weights[r] - m;
+                deviations += d*d;
+            }
+            return std::sqrt(deviations/(replicas_*(replicas_-1)));
+        }
+        //@}
+        //! \name Modifiers
+        //@{
+        void add(const Block& block) {
+            std::vector<Block>::iterator i =
+                std::lower_bound(blocks_.begin(), blocks_.end(), block);
+            QL_REQUIRE(i == blocks_.end() || i->index != block.index,
+                       "block " << block.index << " added twice");
+            blocks_.insert(i, block);
+        }
+        //! adds the sums of the given weighted samples as a block
+        void add(Size index, const Real* values, const Real* weights,
+                 Size samples) {
+            Block block = { index, samples, 0.0, 0.0, 0.0 };
+            for (Size i=0; i<samples; ++i) {
+                Real weighted = weights[i]*values[i];
+                block.weightSum += weights[i];
+                block.valueSum += weighted;
+                block.squareSum += weighted*values[i];
+            }
+            add(block);
+        }
+        //! adds the blocks of a disjoint shard of the same run
+        void merge(const McShardResult& other) {
+            if (seed_ == 0 && blocks_.empty()) {
+                replicas_ = other.replicas_;
+                seed_ = other.seed_;
+                totalSamples_ = other.totalSamples_;
+                dimension_ = other.dimension_;
+            }
+            QL_REQUIRE(other.seed_ == seed_ &&
+                       other.totalSamples_ == totalSamples_ &&
+                       other.dimension_ == dimension_,
+                       "shards of different runs: seeds " << seed_
+                       << " and " << other.seed_ << ", "
+                       << totalSamples_ << " and " << other.totalSamples_
+                       << " samples, dimensions " << dimension_
+                       << " and " << other.dimension_);
+            QL_REQUIRE(other.replicas_ == replicas_,
+                       "shards with " << replicas_ << " and "
+                       << other.replicas_ << " replicas");
+            for (Size i=0; i<other.blocks_.size(); ++i)
+                add(other.blocks_[i]);
+        }
+        void reset() { blocks_.clear(); }
+        //@}
+        //! \name Persistence
+        //@{
+        void save(const std::string& fileName) const {
+            std::ofstream out(fileName.c_str());
+            QL_REQUIRE(out, "cannot create " << fileName);
+            out << "McShardResult 2\n"
+                << "replicas " << replicas_ << "\n"
+                << "seed " << seed_ << "\n"
+                << "samples " << totalSamples_ << "\n"
+                << "dimension " << dimension_ << "\n"
+                << "blocks " << blocks_.size() << "\n"
+                << std::setprecision(17);
+            for (Size i=0; i<blocks_.size(); ++i)
+                out << blocks_[i].index << " "
+                    << blocks_[i].samples << " "
+                    << blocks_[i].weightSum << " "
+                    << blocks_[i].valueSum << " "
+                    << blocks_[i].squareSum << "\n";
+            QL_REQUIRE(out, "error writing " << fileName);
+        }
+        static McShardResult load(const std::string& fileName) {
+            std::ifstream in(fileName.c_str());
+            QL_REQUIRE(in, "cannot open " << fileName);
+            std::string tag;
+            Size version = 0, replicas = 0, blocks = 0;
+            BigNatural seed = 0;
+            Size samples = 0, dimension = 0;
+            in >> tag >> version;
+            QL_REQUIRE(in && tag == "McShardResult" && version == 2,
+                       fileName << " is not a shard result");
+            in >> tag >> replicas;
+            QL_REQUIRE(in && tag == "replicas" && replicas > 0,
+                       "invalid replicas in " << fileName);
+            in >> tag >> seed;
+            QL_REQUIRE(in && tag == "seed" && seed != 0,
+                       "invalid seed in " << fileName);
+            in >> tag >> samples;
+            QL_REQUIRE(in && tag == "samples" && samples > 0,
+                       "invalid number of samples in " << fileName);
+            in >> tag >> dimension;
+            QL_REQUIRE(in && tag == "dimension" && dimension > 0,
+                       "invalid dimension in " << fileName);
+            in >> tag >> blocks;
+            QL_REQUIRE(in && tag == "blocks",
+                       "invalid block count in " << fileName);
+            McShardResult result(replicas, seed, samples, dimension);
+            for (Size i=0; i<blocks; ++i) {
+                Block b;
+                in >> b.index >> b.samples
+                   >> b.weightSum >> b.valueSum >> b.squareSum;
+                QL_REQUIRE(in, "invalid block " << i << " in " << fileName);
+                result.add(b);
+            }
+            QL_REQUIRE(result.samples() <= samples,
+                       fileName << " holds " << result.samples()
+                       << " samples of a run of " << samples);
+            return result;
+        }
+        //@}
+      private:
+        Size replicas_;
+        BigNatural seed_;
+        Size totalSamples_, dimension_;
+        std::vector<Block> blocks_;
+    };
+
+
+    //! Blocks of a Monte Carlo run simulated by one of its shards
+    /*! The blocks of the run are split in contiguous ranges whose
+        sizes differ by one block at most; only the last block of the
+        run can be partial.
+    */
+    class McShardRange {
+      public:
+        McShardRange(Size samples, Size samplesPerBlock,
+                     Size shard = 0, Size shards = 1)
+        : totalSamples_(samples) {
+            QL_REQUIRE(samplesPerBlock > 0, "empty blocks given");
+            QL_REQUIRE(shard < shards,
+                       "shard " << shard << " out of " << shards
+                       << " given");
+            Size blocks = (samples + samplesPerBlock-1) / samplesPerBlock;
+            QL_REQUIRE(shards <= blocks,
+                       shards << " shards given for " << blocks
+                       << " blocks of samples");
+            firstBlock_ = shard*blocks/shards;
+            lastBlock_ = (shard+1)*blocks/shards;
+            samples_ = std::min(lastBlock_*samplesPerBlock, samples)
+                     - firstBlock_*samplesPerBlock;
+        }
+        //! samples of the whole run
+        Size totalSamples() const { return totalSamples_; }
+        //! samples of the shard
+        Size samples() const { return samples_; }
+        Size firstBlock() const { return firstBlock_; }
+        //! one past the last block of the shard
+        Size lastBlock() const { return lastBlock_; }
+      private:
+        Size totalSamples_, samples_, firstBlock_, lastBlock_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,278 @@
+/*! \file mcspecializedeuropeanengine.hpp
+    \brief Monte Carlo European engine specialized on process and payoff
+*/
+
+#ifndef mc_specialized_european_engine_hpp
+#define mc_specialized_european_engine_hpp
+
+#include "mceuropeanengine.hpp"
+#include <algorithm>
+#include <typeinfo>
+
+namespace QuantLib {
+
+    //! plain-vanilla payoff whose type is known at compile time
+    /*! Unlike PlainVanillaPayoff, whose call operator is virtual and
+        defined out of line, this class can be inlined in the sample
+        loop of MCSpecializedEuropeanEngine_2.
+    */
+    template <Option::Type Type>
+    class StaticVanillaPayoff_2 {
+      public:
+        explicit StaticVanillaPayoff_2(const PlainVanillaPayoff& payoff)
+        : strike_(payoff.strike()) {
+            QL_REQUIRE(accepts(payoff), "wrong payoff type");
+        }
+        //! whether the given payoff can be replaced by this class
+        static bool accepts(const PlainVanillaPayoff& payoff) {
+            return payoff.optionType() == Type;
+        }
+        Real operator()(Real price) const {
+            return Type == Option::Call ? std::max<Real>(price-strike_, 0.0)
+                                        : std::max<Real>(strike_-price, 0.0);
+        }
+      private:
+        Real strike_;
+    };
+
+    typedef StaticVanillaPayoff_2<Option::Call> StaticCallPayoff_2;
+    typedef StaticVanillaPayoff_2<Option::Put> StaticPutPayoff_2;
+
+
+    //! Monte Carlo European engine specialized on process and payoff
+    /*! \ingroup vanillaengines
+
+        This engine works as MCEuropeanEngine_2 in block mode (which
+        it always uses, on one thread unless specified), but its
+        sample loop is compiled for the given process and payoff
+        types: the evolve() method of \c ProcessType is called
+        directly instead of through the StochasticProcess1D
+        interface, the payoff is a \c PayoffType instance, and only
+        the value of the underlying at maturity is kept.  With
+        ConstantBlackScholesProcess and StaticVanillaPayoff_2, the
+        whole loop over time steps can be inlined.
+
+        \c PayoffType must be constructible from a PlainVanillaPayoff
+        and provide a static accepts() method telling whether a given
+        payoff can be replaced, as StaticVanillaPayoff_2 does.
+
+        The process used is the ConstantBlackScholesProcess or
+        GridBlackScholesProcess built by the engine when constant or
+        grid parameters are requested, and the given process
+        otherwise.  If its dynamic type is not exactly
+        \c ProcessType, or the payoff is not accepted by
+        \c PayoffType, the engine falls back to the sample loop of
+        MCEuropeanEngine_2; the same happens in terminal-sampling and
+        path-batch modes, which don't use that loop, and with
+        stratified, moment-matched or importance sampling.  Whether the
+        specialized loop was used is returned as the "specialized"
+        additional result.  The samples are the same in both cases.
+    */
+    template <class ProcessType, class PayoffType,
+              class RNG = PseudoRandom, class S = Statistics>
+    class MCSpecializedEuropeanEngine_2 : public MCEuropeanEngine_2<RNG,S> {
+      public:
+        MCSpecializedEuropeanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool brownianBridge,
+             bool antitheticVariate,
+             Size requiredSamples,
+             Real requiredTolerance,
+             Size maxSamples,
+             BigNatural seed,
+             const MCEuropeanEngineOptions_2& options =
+                                             MCEuropeanEngineOptions_2());
+        void calculate() const;
+      protected:
+        typedef typename MCEuropeanEngine_2<RNG,S>::Workspace Workspace;
+        bool blockMode() const { return true; }
+        boost::shared_ptr<StochasticProcess1D> makeBlockProcess() const;
+        void simulateBlock(Workspace& workspace,
+                           Size block,
+                           Size samples,
+                           Real* values,
+                           Real* weights,
+                           Real* controls,
+                           Real* greeks,
+                           Real* ratios) const;
+      private:
+        Real evolve(const ProcessType& process,
+                    const Real* draws,
+                    Real sign) const;
+        mutable boost::shared_ptr<ProcessType> staticProcess_;
+        mutable boost::shared_ptr<PayoffType> staticPayoff_;
+        mutable DiscountFactor staticDiscount_;
+    };
+
+
+    // inline definitions
+
+    template <class P, class F, class RNG, class S>
+    inline MCSpecializedEuropeanEngine_2<P,F,RNG,S>::
+    MCSpecializedEuropeanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size timeSteps,
+             Size timeStepsPerYear,
+             bool brownianBridge,
+             bool antitheticVariate,
+             Size requiredSamples,
+             Real requiredTolerance,
+             Size maxSamples,
+             BigNatural seed,
+             const MCEuropeanEngineOptions_2& options)
+    : MCEuropeanEngine_2<RNG,S>(process, timeSteps, timeStepsPerYear,
+                                brownianBridge, antitheticVariate,
+                                requiredSamples, requiredTolerance,
+                                maxSamples, seed, options) {}
+
+    template <class P, class F, class RNG, class S>
+    inline void MCSpecializedEuropeanEngine_2<P,F,RNG,S>::calculate() const {
+        staticProcess_.reset();
+        staticPayoff_.reset();
+
+        MCEuropeanEngine_2<RNG,S>::calculate();
+        this->results_.additionalResults["specialized"] =
+            bool(staticProcess_);
+    }
+
+    template <class P, class F, class RNG, class S>
+    inline boost::shared_ptr<StochasticProcess1D>
+    MCSpecializedEuropeanEngine_2<P,F,RNG,S>::makeBlockProcess() const {
+        boost::shared_ptr<StochasticProcess1D> blockProcess =
+            MCEuropeanEngine_2<RNG,S>::makeBlockProcess();
+
+        // called once per calculation, before any block is simulated
+        boost::shared_ptr<P> process =
+            boost::dynamic_pointer_cast<P>(blockProcess);
+        // a derived class might override evolve(), which the
+        // specialized loop calls without virtual dispatch
+        if (process && typeid(*process) != typeid(P))
+            process.reset();
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                this->arguments_.payoff);
+        boost::shared_ptr<GeneralizedBlackScholesProcess> bsProcess =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(
+                this->process_);
+
+        if (process && payoff && F::accepts(*payoff) && bsProcess
+            && !this->options_.terminalSampling
+            && this->options_.pathBatchSize == Null<Size>()
+            && this->options_.sampling == EuropeanSampling_2::Independent
+            && !this->options_.momentMatching
+            && !this->options_.importanceSampling) {
+            staticProcess_ = process;
+            staticPayoff_ = boost::shared_ptr<F>(new F(*payoff));
+            staticDiscount_ =
+                bsProcess->riskFreeRate()->discount(this->timeGrid().back());
+        }
+        return blockProcess;
+    }
+
+    template <class P, class F, class RNG, class S>
+    inline void MCSpecializedEuropeanEngine_2<P,F,RNG,S>::simulateBlock(
+                                                   Workspace& workspace,
+                                                   Size block,
+                                                   Size samples,
+                                                   Real* values,
+                                                   Real* weights,
+                                                   Real* controls,
+                                                   Real* greeks,
+                                                   Real* ratios) const {
+        if (!staticProcess_) {
+            MCEuropeanEngine_2<RNG,S>::simulateBlock(workspace, block,
+                                                     samples, values,
+                                                     weights, controls,
+                                                     greeks, ratios);
+            return;
+        }
+
+        typedef typename MCEuropeanEngine_2<RNG,S>::block_generator_type
+            generator_type;
+        typedef typename generator_type::sample_type sequence_type;
+
+        const Size dimension = this->blockGrid_.size()-1;
+        generator_type* generator = 0;
+        const Real* readyDraws = workspace.readyDraws;
+        if (!readyDraws)
+            generator = &this->blockGenerator(workspace, block);
+        const P& process = *staticProcess_;
+        const F payoff = *staticPayoff_;
+        const DiscountFactor discount = staticDiscount_;
+        const bool antithetic = this->antitheticVariate_;
+        Real* draws = workspace.draws;
+
+        for (Size i=0; i<samples; ++i) {
+            const Real* z;
+            if (readyDraws) {
+                z = readyDraws + i*dimension;
+                weights[i] = workspace.readyWeights[i];
+            } else {
+                const sequence_type& sequence = generator->nextSequence();
+                z = &sequence.value[0];
+                weights[i] = sequence.weight;
+            }
+            if (this->brownianBridge_)
+                workspace.bridge->transform(z, z+dimension, draws);
+            else
+                std::copy(z, z+dimension, draws);
+            Real underlying = evolve(process, draws, 1.0);
+            Real price = discount * payoff(underlying);
+            Real control = 0.0, w = 0.0;
+            if (controls) {
+                for (Size j=0; j<this->controlSqrtDt_.size(); ++j)
+                    w += this->controlSqrtDt_[j]*draws[j];
+                control = this->controlValue(underlying, w);
+            }
+            Real* g = greeks ? greeks+3*i : 0;
+            Real greekWeight = antithetic ? 0.5 : 1.0;
+            if (g) {
+                std::fill(g, g+3, 0.0);
+                this->addGreeks(underlying, greekWeight, g);
+            }
+            if (antithetic) {
+                underlying = evolve(process, draws, -1.0);
+                price = (price + discount * payoff(underlying))/2.0;
+                if (controls)
+                    control = (control +
+                               this->controlValue(underlying, -w))/2.0;
+                if (g)
+                    this->addGreeks(underlying, greekWeight, g);
+            }
+            values[i] = price;
+            if (controls)
+                controls[i] = control;
+        }
+    }
+
+    template <class P, class F, class RNG, class S>
+    inline Real MCSpecializedEuropeanEngine_2<P,F,RNG,S>::evolve(
+                                                      const P& process,
+                                                      const Real* draws,
+                                                      Real sign) const {
+        // same steps as evolvePath, but with a qualified (hence
+        // non-virtual) call and no path storage
+        const TimeGrid& grid = this->blockGrid_;
+        Real x = process.P::x0();
+        for (Size i=1; i<grid.size(); ++i)
+            x = process.P::evolve(grid[i-1], x, grid.dt(i-1),
+                                  sign*draws[i-1]);
+        return x;
+    }
+
+
+    template <class RNG, class S>
+    template <class ProcessType, class PayoffType>
+    inline boost::shared_ptr<PricingEngine>
+    MakeMCEuropeanEngine_2<RNG,S>::specializedEngine() const {
+        return makeEngine<MCSpecializedEuropeanEngine_2<ProcessType,
+                                                        PayoffType,
+                                                        RNG,S> >();
+    }
+
+}
+
+
+#endif
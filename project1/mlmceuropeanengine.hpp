@@ -0,0 +1,521 @@
+/*! \file mlmceuropeanengine.hpp
+    \brief Multilevel Monte Carlo European engine
+*/
+
+#ifndef mlmc_european_engine_hpp
+#define mlmc_european_engine_hpp
+
+#include <ql/instruments/vanillaoption.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include <ql/methods/montecarlo/path.hpp>
+#include "multipathpricer.hpp"
+#include "mceuropeanengine.hpp"
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Multilevel Monte Carlo estimator of a path payoff
+    /*! Implements the algorithm of M. Giles, "Multilevel Monte Carlo
+        path simulation", Operations Research 56(3), 2008.  Level
+        \f$ l \f$ simulates paths with \f$ M_0 2^l \f$ steps; for
+        \f$ l > 0 \f$ each fine path is coupled to a coarse path with
+        half as many steps, driven by the sums of pairs of its
+        Brownian increments, and the level estimates the mean of the
+        difference between the payoffs on the two paths.  The sum of
+        the level estimates is an estimate of the payoff on the
+        finest level.
+
+        simulate() picks the number of levels and of samples per
+        level so that the root mean-square error is below the given
+        target: samples are allocated to minimize the cost for a
+        statistical error of \f$ \epsilon/\sqrt{2} \f$, and levels are
+        added until the estimated bias, extrapolated from the decay
+        of the level means, is below \f$ \epsilon/\sqrt{2} \f$.
+        The bias can only be estimated from two levels or more; a
+        single level (i.e., at most one) is meant for an exact
+        discretization, whose bias is null, and the whole error is
+        then given to the statistical error.
+
+        The paths are generated with the evolve() method of the
+        process, i.e., with its own discretization.  The cost of a
+        sample is counted as the number of steps it evolves; the
+        measured time spent on each level is also available.
+    */
+    template <class RNG = PseudoRandom>
+    class MultilevelMonteCarlo_2 : private boost::noncopyable {
+      public:
+        MultilevelMonteCarlo_2(
+                    const boost::shared_ptr<StochasticProcess1D>& process,
+                    const boost::shared_ptr<PathPayoff_2>& payoff,
+                    Time maturity,
+                    DiscountFactor discount,
+                    Size coarsestSteps,
+                    BigNatural seed,
+                    Size pilotSamples = 1000,
+                    Size minLevels = 3,
+                    Size maxLevels = 10);
+        //! adds samples until the target RMSE is met
+        void simulate(Real rmse);
+        //! \name Inspectors
+        //@{
+        Real value() const;
+        //! statistical error of the estimate
+        Real errorEstimate() const;
+        Size levels() const { return levels_.size(); }
+        Size timeSteps(Size level) const { return coarsestSteps_ << level; }
+        Size samples(Size level) const { return levels_.at(level)->samples; }
+        Real mean(Size level) const;
+        Real variance(Size level) const;
+        //! number of time steps simulated on the given level
+        Real cost(Size level) const;
+        //! wall-clock time spent on the given level, in seconds
+        Real time(Size level) const { return levels_.at(level)->time; }
+        /*! estimated cost, in time steps, of a standard Monte Carlo
+            simulation with the same finest level and RMSE */
+        Real singleLevelCost(Real rmse) const;
+        //@}
+      private:
+        struct Level : private boost::noncopyable {
+            Level(const typename RNG::rsg_type& generator,
+                  Time maturity, Size steps)
+            : generator(generator), fine(TimeGrid(maturity, steps)),
+              coarse(TimeGrid(maturity, std::max<Size>(steps/2, 1))),
+              samples(0), sum(0.0), sum2(0.0), time(0.0) {}
+            typename RNG::rsg_type generator;
+            Path fine, coarse;
+            Size samples;
+            Real sum, sum2, time;
+        };
+        void addLevel();
+        void addSamples(Size level, Size samples);
+        Real sampleCost(Size level) const;
+        // share of the MSE given to the bias
+        Real biasShare() const { return maxLevels_ > 1 ? 0.5 : 0.0; }
+        static Real decayRate(const std::vector<Real>& values);
+        boost::shared_ptr<StochasticProcess1D> process_;
+        boost::shared_ptr<PathPayoff_2> payoff_;
+        Time maturity_;
+        DiscountFactor discount_;
+        Size coarsestSteps_;
+        BigNatural seed_;
+        Size pilotSamples_, minLevels_, maxLevels_;
+        std::vector<boost::shared_ptr<Level> > levels_;
+    };
+
+
+    //! European option pricing engine using multilevel Monte Carlo
+    /*! The payoff is evaluated on paths generated by the evolve()
+        method of the process, with a number of steps chosen by
+        MultilevelMonteCarlo_2 to meet the required tolerance (taken
+        as the target root mean-square error).  This pays off when
+        the process needs a fine discretization, e.g., with a local
+        volatility; with an exact log-normal discretization, coarse
+        and fine paths coincide and a single level is used, with
+        the coarsest number of steps; this is plain Monte Carlo with
+        a sample size set by the tolerance.
+
+        The number of levels and the samples, variance, cost (in time
+        steps) and wall-clock time of each level are returned as the
+        "levels", "samplesPerLevel", "variancePerLevel",
+        "costPerLevel" and "timePerLevel" additional results;
+        "singleLevelCost" is the estimated cost of a standard Monte
+        Carlo simulation with the same accuracy.
+
+        \ingroup vanillaengines
+    */
+    template <class RNG = PseudoRandom>
+    class MLMCEuropeanEngine_2 : public VanillaOption::engine {
+      public:
+        MLMCEuropeanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size coarsestSteps,
+             Real requiredTolerance,
+             BigNatural seed,
+             Size pilotSamples = 1000,
+             Size maxLevels = 10);
+        void calculate() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size coarsestSteps_;
+        Real requiredTolerance_;
+        BigNatural seed_;
+        Size pilotSamples_, maxLevels_;
+    };
+
+
+    //! Multilevel Monte Carlo European engine factory
+    template <class RNG = PseudoRandom>
+    class MakeMLMCEuropeanEngine_2 {
+      public:
+        MakeMLMCEuropeanEngine_2(
+                    const boost::shared_ptr<GeneralizedBlackScholesProcess>&);
+        // named parameters
+        MakeMLMCEuropeanEngine_2& withCoarsestSteps(Size steps);
+        MakeMLMCEuropeanEngine_2& withAbsoluteTolerance(Real tolerance);
+        MakeMLMCEuropeanEngine_2& withSeed(BigNatural seed);
+        MakeMLMCEuropeanEngine_2& withPilotSamples(Size samples);
+        MakeMLMCEuropeanEngine_2& withMaxLevels(Size levels);
+        // conversion to pricing engine
+        operator boost::shared_ptr<PricingEngine>() const;
+      private:
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process_;
+        Size steps_;
+        Real tolerance_;
+        BigNatural seed_;
+        Size pilotSamples_, maxLevels_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG>
+    inline MultilevelMonteCarlo_2<RNG>::MultilevelMonteCarlo_2(
+                    const boost::shared_ptr<StochasticProcess1D>& process,
+                    const boost::shared_ptr<PathPayoff_2>& payoff,
+                    Time maturity,
+                    DiscountFactor discount,
+                    Size coarsestSteps,
+                    BigNatural seed,
+                    Size pilotSamples,
+                    Size minLevels,
+                    Size maxLevels)
+    : process_(process), payoff_(payoff), maturity_(maturity),
+      discount_(discount), coarsestSteps_(coarsestSteps), seed_(seed),
+      pilotSamples_(pilotSamples), minLevels_(minLevels),
+      maxLevels_(maxLevels) {
+        QL_REQUIRE(process_, "null process given");
+        QL_REQUIRE(payoff_, "null payoff given");
+        QL_REQUIRE(maturity_ > 0.0, "positive maturity required");
+        QL_REQUIRE(coarsestSteps_ > 0, "at least one time step required");
+        QL_REQUIRE(pilotSamples_ > 1, "at least two pilot samples required");
+        QL_REQUIRE(minLevels_ > 0 && minLevels_ <= maxLevels_ &&
+                   (minLevels_ > 1 || maxLevels_ == 1),
+                   "invalid number of levels (min " << minLevels_
+                   << ", max " << maxLevels_ << ")");
+        if (seed_ == 0)
+            seed_ = SeedGenerator::instance().get();
+    }
+
+    template <class RNG>
+    inline void MultilevelMonteCarlo_2<RNG>::addLevel() {
+        Size level = levels_.size();
+        Size steps = timeSteps(level);
+        levels_.push_back(boost::shared_ptr<Level>(new Level(
+            RNG::make_sequence_generator(steps,
+                                         detail::mcBlockSeed(seed_, level)),
+            maturity_, steps)));
+    }
+
+    template <class RNG>
+    inline void MultilevelMonteCarlo_2<RNG>::addSamples(Size level,
+                                                        Size samples) {
+        typedef typename RNG::rsg_type::sample_type sequence_type;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        Level& l = *levels_[level];
+        const StochasticProcess1D& process = *process_;
+        const PathPayoff_2& payoff = *payoff_;
+        Path& fine = l.fine;
+        Path& coarse = l.coarse;
+        const TimeGrid& fineGrid = fine.timeGrid();
+        const TimeGrid& coarseGrid = coarse.timeGrid();
+        Real x0 = process.x0();
+
+        for (Size i=0; i<samples; ++i) {
+            const sequence_type& sequence = l.generator.nextSequence();
+            const std::vector<Real>& z = sequence.value;
+
+            fine[0] = x0;
+            for (Size j=0; j<z.size(); ++j)
+                fine[j+1] = process.evolve(fineGrid[j], fine[j],
+                                           fineGrid.dt(j), z[j]);
+            Real y = payoff(fine);
+
+            if (level > 0) {
+                // the coarse path sees the sum of two fine increments
+                coarse[0] = x0;
+                for (Size j=0; j<coarseGrid.size()-1; ++j) {
+                    Real dw = (z[2*j] + z[2*j+1])/M_SQRT2;
+                    coarse[j+1] = process.evolve(coarseGrid[j], coarse[j],
+                                                 coarseGrid.dt(j), dw);
+                }
+                y -= payoff(coarse);
+            }
+
+            y *= discount_;
+            l.sum += y;
+            l.sum2 += y*y;
+        }
+        l.samples += samples;
+        l.time += std::chrono::duration<Real>(
+                      std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <class RNG>
+    inline void MultilevelMonteCarlo_2<RNG>::simulate(Real rmse) {
+        QL_REQUIRE(rmse > 0.0, "positive target RMSE required");
+        const Real theta = biasShare();
+
+        while (levels_.size() < minLevels_)
+            addLevel();
+
+        std::vector<Size> extra(levels_.size(), 0);
+        for (Size l=0; l<levels_.size(); ++l)
+            extra[l] = levels_[l]->samples < pilotSamples_ ?
+                       pilotSamples_ - levels_[l]->samples : 0;
+
+        for (;;) {
+            for (Size l=0; l<levels_.size(); ++l)
+                if (extra[l] > 0)
+                    addSamples(l, extra[l]);
+
+            Size L = levels_.size();
+            std::vector<Real> means(L), variances(L);
+            for (Size l=0; l<L; ++l) {
+                means[l] = std::fabs(mean(l));
+                variances[l] = variance(l);
+            }
+            Real alpha = std::max<Real>(0.5, decayRate(means));
+
+            // optimal allocation for the statistical error
+            Real sum = 0.0;
+            for (Size l=0; l<L; ++l)
+                sum += std::sqrt(variances[l]*sampleCost(l));
+            bool converged = true;
+            for (Size l=0; l<L; ++l) {
+                Real optimal = std::ceil(
+                    std::sqrt(variances[l]/sampleCost(l)) * sum
+                    / ((1.0-theta)*rmse*rmse));
+                Size needed = Size(optimal);
+                extra[l] = needed > levels_[l]->samples ?
+                           needed - levels_[l]->samples : 0;
+                if (extra[l] > 0)
+                    converged = false;
+            }
+            if (!converged)
+                continue;
+            if (maxLevels_ == 1)
+                break;
+
+            // bias of the finest level, from the decay of the means
+            Real bias = std::max(means[L-1],
+                                 means[L-2]/std::pow(2.0, alpha))
+                      / (std::pow(2.0, alpha) - 1.0);
+            if (bias <= std::sqrt(theta)*rmse)
+                break;
+
+            QL_REQUIRE(L < maxLevels_,
+                       "max number of levels (" << maxLevels_
+                       << ") reached, while the estimated bias (" << bias
+                       << ") is still above the target ("
+                       << std::sqrt(theta)*rmse << ")");
+            addLevel();
+            extra.push_back(pilotSamples_);
+        }
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::value() const {
+        Real result = 0.0;
+        for (Size l=0; l<levels_.size(); ++l)
+            result += mean(l);
+        return result;
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::errorEstimate() const {
+        Real result = 0.0;
+        for (Size l=0; l<levels_.size(); ++l)
+            result += variance(l)/levels_[l]->samples;
+        return std::sqrt(result);
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::mean(Size level) const {
+        const Level& l = *levels_.at(level);
+        QL_REQUIRE(l.samples > 0, "empty sample set");
+        return l.sum/l.samples;
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::variance(Size level) const {
+        const Level& l = *levels_.at(level);
+        QL_REQUIRE(l.samples > 1, "sample number <= 1, unsufficient");
+        Real n = static_cast<Real>(l.samples);
+        Real m = l.sum/n;
+        return std::max<Real>((l.sum2/n - m*m) * n/(n-1.0), 0.0);
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::sampleCost(Size level) const {
+        // fine steps, plus coarse ones on the correction levels
+        Real steps = static_cast<Real>(timeSteps(level));
+        return level > 0 ? 1.5*steps : steps;
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::cost(Size level) const {
+        return sampleCost(level) * levels_.at(level)->samples;
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::singleLevelCost(
+                                                        Real rmse) const {
+        // the payoff on the finest level has about the variance of
+        // the payoff on the coarsest one
+        Real samples = std::ceil(variance(0)/
+                                 ((1.0-biasShare())*rmse*rmse));
+        return samples * static_cast<Real>(timeSteps(levels_.size()-1));
+    }
+
+    template <class RNG>
+    inline Real MultilevelMonteCarlo_2<RNG>::decayRate(
+                                           const std::vector<Real>& values) {
+        // least-squares slope of -log2(values[l]) for l >= 1,
+        // skipping null values
+        Real n = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        for (Size l=1; l<values.size(); ++l) {
+            if (values[l] <= 0.0)
+                continue;
+            Real x = static_cast<Real>(l), y = -std::log(values[l])/M_LN2;
+            n += 1.0;
+            sx += x;
+            sy += y;
+            sxx += x*x;
+            sxy += x*y;
+        }
+        if (n < 2.0)
+            return 1.0;
+        return (n*sxy - sx*sy)/(n*sxx - sx*sx);
+    }
+
+
+    template <class RNG>
+    inline MLMCEuropeanEngine_2<RNG>::MLMCEuropeanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             Size coarsestSteps,
+             Real requiredTolerance,
+             BigNatural seed,
+             Size pilotSamples,
+             Size maxLevels)
+    : process_(process), coarsestSteps_(coarsestSteps),
+      requiredTolerance_(requiredTolerance), seed_(seed),
+      pilotSamples_(pilotSamples), maxLevels_(maxLevels) {
+        QL_REQUIRE(maxLevels_ > 1, "at least two levels required");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        registerWith(process_);
+    }
+
+    template <class RNG>
+    inline void MLMCEuropeanEngine_2<RNG>::calculate() const {
+        QL_REQUIRE(arguments_.exercise->type() == Exercise::European,
+                   "not an European option");
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(
+                arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        Time maturity = process_->time(arguments_.exercise->lastDate());
+        // an exact discretization has no bias to reduce
+        bool exact = detail::hasExactLogNormalTransition(process_);
+        MultilevelMonteCarlo_2<RNG> mlmc(
+            process_,
+            boost::shared_ptr<PathPayoff_2>(new EuropeanPathPayoff_2(
+                               payoff->optionType(), payoff->strike())),
+            maturity,
+            process_->riskFreeRate()->discount(maturity),
+            coarsestSteps_, seed_, pilotSamples_,
+            exact ? 1 : std::min<Size>(3, maxLevels_),
+            exact ? 1 : maxLevels_);
+        mlmc.simulate(requiredTolerance_);
+
+        results_.value = mlmc.value();
+        results_.errorEstimate = mlmc.errorEstimate();
+
+        Size levels = mlmc.levels();
+        std::vector<Size> samples(levels);
+        std::vector<Real> variances(levels), costs(levels), times(levels);
+        for (Size l=0; l<levels; ++l) {
+            samples[l] = mlmc.samples(l);
+            variances[l] = mlmc.variance(l);
+            costs[l] = mlmc.cost(l);
+            times[l] = mlmc.time(l);
+        }
+        results_.additionalResults["levels"] = levels;
+        results_.additionalResults["samplesPerLevel"] = samples;
+        results_.additionalResults["variancePerLevel"] = variances;
+        results_.additionalResults["costPerLevel"] = costs;
+        results_.additionalResults["timePerLevel"] = times;
+        results_.additionalResults["singleLevelCost"] =
+            mlmc.singleLevelCost(requiredTolerance_);
+    }
+
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>::MakeMLMCEuropeanEngine_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process)
+    : process_(process), steps_(1), tolerance_(Null<Real>()), seed_(0),
+      pilotSamples_(1000), maxLevels_(10) {}
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>&
+    MakeMLMCEuropeanEngine_2<RNG>::withCoarsestSteps(Size steps) {
+        QL_REQUIRE(steps > 0, "at least one time step required");
+        steps_ = steps;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>&
+    MakeMLMCEuropeanEngine_2<RNG>::withAbsoluteTolerance(Real tolerance) {
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        tolerance_ = tolerance;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>&
+    MakeMLMCEuropeanEngine_2<RNG>::withSeed(BigNatural seed) {
+        seed_ = seed;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>&
+    MakeMLMCEuropeanEngine_2<RNG>::withPilotSamples(Size samples) {
+        pilotSamples_ = samples;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>&
+    MakeMLMCEuropeanEngine_2<RNG>::withMaxLevels(Size levels) {
+        QL_REQUIRE(levels > 1, "at least two levels required");
+        maxLevels_ = levels;
+        return *this;
+    }
+
+    template <class RNG>
+    inline MakeMLMCEuropeanEngine_2<RNG>::operator
+    boost::shared_ptr<PricingEngine>() const {
+        QL_REQUIRE(tolerance_ != Null<Real>(), "tolerance not given");
+        return boost::shared_ptr<PricingEngine>(
+            new MLMCEuropeanEngine_2<RNG>(process_, steps_, tolerance_,
+                                          seed_, pilotSamples_,
+                                          maxLevels_));
+    }
+
+}
+
+
+#endif
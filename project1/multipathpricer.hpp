@@ -0,0 +1,325 @@
+/*! \file multipathpricer.hpp
+    \brief Several payoffs priced on the same Monte Carlo paths
+*/
+
+#ifndef multi_path_pricer_hpp
+#define multi_path_pricer_hpp
+
+#include <ql/methods/montecarlo/pathpricer.hpp>
+#include <ql/methods/montecarlo/pathgenerator.hpp>
+#include <ql/methods/montecarlo/path.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include <ql/math/statistics/statistics.hpp>
+#include <ql/math/array.hpp>
+#include <ql/instruments/payoffs.hpp>
+#include <ql/instruments/barriertype.hpp>
+#include <ql/instruments/averagetype.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! undiscounted payoff depending on the path of the underlying
+    /*! All payoffs are paid at the end of the path. */
+    class PathPayoff_2 {
+      public:
+        virtual ~PathPayoff_2() {}
+        virtual Real operator()(const Path& path) const = 0;
+    };
+
+
+    //! plain-vanilla payoff on the underlying value at maturity
+    class EuropeanPathPayoff_2 : public PathPayoff_2 {
+      public:
+        EuropeanPathPayoff_2(Option::Type type, Real strike)
+        : payoff_(type, strike) {}
+        Real operator()(const Path& path) const {
+            return payoff_(path.back());
+        }
+      private:
+        PlainVanillaPayoff payoff_;
+    };
+
+
+    //! fixed-strike Asian payoff on the fixings of the path
+    /*! The average is taken over all the points of the path but the
+        first one.
+    */
+    class AsianPathPayoff_2 : public PathPayoff_2 {
+      public:
+        AsianPathPayoff_2(Average::Type averageType,
+                          Option::Type type,
+                          Real strike)
+        : averageType_(averageType), payoff_(type, strike) {}
+        Real operator()(const Path& path) const {
+            Size n = path.length()-1;
+            QL_REQUIRE(n > 0, "at least one fixing required");
+            Real average;
+            if (averageType_ == Average::Arithmetic) {
+                Real sum = 0.0;
+                for (Size i=1; i<=n; ++i)
+                    sum += path[i];
+                average = sum/n;
+            } else {
+                Real logSum = 0.0;
+                for (Size i=1; i<=n; ++i)
+                    logSum += std::log(path[i]);
+                average = std::exp(logSum/n);
+            }
+            return payoff_(average);
+        }
+      private:
+        Average::Type averageType_;
+        PlainVanillaPayoff payoff_;
+    };
+
+
+    //! discretely-monitored barrier payoff
+    /*! The barrier is checked on all the points of the path; the
+        rebate, if any, is paid at maturity when the option is
+        knocked out or never knocked in.
+    */
+    class BarrierPathPayoff_2 : public PathPayoff_2 {
+      public:
+        BarrierPathPayoff_2(Barrier::Type barrierType,
+                            Real barrier,
+                            Real rebate,
+                            Option::Type type,
+                            Real strike)
+        : barrierType_(barrierType), barrier_(barrier), rebate_(rebate),
+          payoff_(type, strike) {}
+        Real operator()(const Path& path) const {
+            bool touched = false;
+            switch (barrierType_) {
+              case Barrier::DownIn:
+              case Barrier::DownOut:
+                touched = *std::min_element(path.begin(), path.end())
+                          <= barrier_;
+                break;
+              case Barrier::UpIn:
+              case Barrier::UpOut:
+                touched = *std::max_element(path.begin(), path.end())
+                          >= barrier_;
+                break;
+              default:
+                QL_FAIL("unknown barrier type");
+            }
+            bool knockIn = (barrierType_ == Barrier::DownIn ||
+                            barrierType_ == Barrier::UpIn);
+            if (touched == knockIn)
+                return payoff_(path.back());
+            else
+                return rebate_;
+        }
+      private:
+        Barrier::Type barrierType_;
+        Real barrier_, rebate_;
+        PlainVanillaPayoff payoff_;
+    };
+
+
+    //! floating-strike lookback payoff
+    /*! A call pays the final value minus the minimum of the path, a
+        put pays the maximum of the path minus the final value.
+    */
+    class LookbackPathPayoff_2 : public PathPayoff_2 {
+      public:
+        explicit LookbackPathPayoff_2(Option::Type type) : type_(type) {}
+        Real operator()(const Path& path) const {
+            switch (type_) {
+              case Option::Call:
+                return path.back()
+                    - *std::min_element(path.begin(), path.end());
+              case Option::Put:
+                return *std::max_element(path.begin(), path.end())
+                    - path.back();
+              default:
+                QL_FAIL("unknown option type");
+            }
+        }
+      private:
+        Option::Type type_;
+    };
+
+
+    //! path pricer returning the discounted values of several payoffs
+    /*! This is the multi-payoff counterpart of EuropeanPathPricer_2:
+        every payoff is evaluated on each path, so that pricing K
+        instruments costs a single simulation.
+    */
+    class MultiPathPricer_2 : public PathPricer<Path,Array> {
+      public:
+        MultiPathPricer_2(
+               const std::vector<boost::shared_ptr<PathPayoff_2> >& payoffs,
+               DiscountFactor discount)
+        : payoffs_(payoffs), discount_(discount) {
+            QL_REQUIRE(!payoffs_.empty(), "no payoffs given");
+            for (Size i=0; i<payoffs_.size(); ++i)
+                QL_REQUIRE(payoffs_[i], "null payoff given");
+        }
+        Array operator()(const Path& path) const {
+            Array values(payoffs_.size());
+            (*this)(path, values.begin());
+            return values;
+        }
+        //! writes the discounted values in the given buffer
+        void operator()(const Path& path, Real* values) const {
+            QL_REQUIRE(path.length() > 0, "the path cannot be empty");
+            for (Size i=0; i<payoffs_.size(); ++i)
+                values[i] = (*payoffs_[i])(path) * discount_;
+        }
+        Size size() const { return payoffs_.size(); }
+      private:
+        std::vector<boost::shared_ptr<PathPayoff_2> > payoffs_;
+        DiscountFactor discount_;
+    };
+
+
+    //! Monte Carlo simulation pricing several payoffs at once
+    /*! Paths are generated once and passed to a MultiPathPricer_2;
+        an instance of the statistics class collects the samples of
+        each payoff.  With antithetic variates, each sample is the
+        average of the values on the path and on its antithetic.
+
+        In tolerance mode, samples are added until the largest error
+        estimate among the payoffs is below the tolerance, using the
+        same sizing strategy as McSimulation::value.
+    */
+    template <class RNG = PseudoRandom, class S = Statistics>
+    class MCMultiPayoffSimulation_2 {
+      public:
+        typedef typename RNG::rsg_type rsg_type;
+        typedef PathGenerator<rsg_type> path_generator_type;
+        MCMultiPayoffSimulation_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PathPayoff_2> >& payoffs,
+             Time maturity,
+             Size timeSteps,
+             bool brownianBridge,
+             bool antitheticVariate,
+             BigNatural seed);
+        //! adds the given number of samples
+        void addSamples(Size samples);
+        //! adds samples until the given tolerance is reached
+        void addSamplesToTolerance(Real tolerance,
+                                   Size maxSamples = QL_MAX_INTEGER);
+        //! \name Inspectors
+        //@{
+        Size size() const { return statistics_.size(); }
+        Size samples() const { return samples_; }
+        const S& statistics(Size i) const { return statistics_.at(i); }
+        Array values() const;
+        Array errorEstimates() const;
+        //@}
+      private:
+        Real maxErrorEstimate() const;
+        MultiPathPricer_2 pricer_;
+        path_generator_type generator_;
+        bool antitheticVariate_;
+        std::vector<S> statistics_;
+        Array values_, antitheticValues_;
+        Size samples_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG, class S>
+    inline MCMultiPayoffSimulation_2<RNG,S>::MCMultiPayoffSimulation_2(
+             const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+             const std::vector<boost::shared_ptr<PathPayoff_2> >& payoffs,
+             Time maturity,
+             Size timeSteps,
+             bool brownianBridge,
+             bool antitheticVariate,
+             BigNatural seed)
+    : pricer_(payoffs, process->riskFreeRate()->discount(maturity)),
+      generator_(process, TimeGrid(maturity, timeSteps),
+                 RNG::make_sequence_generator(timeSteps, seed),
+                 brownianBridge),
+      antitheticVariate_(antitheticVariate),
+      statistics_(payoffs.size()),
+      values_(payoffs.size()), antitheticValues_(payoffs.size()),
+      samples_(0) {
+        QL_REQUIRE(timeSteps > 0, "at least one time step required");
+    }
+
+    template <class RNG, class S>
+    inline void MCMultiPayoffSimulation_2<RNG,S>::addSamples(Size samples) {
+        Size n = pricer_.size();
+        for (Size j=0; j<samples; ++j) {
+            const typename path_generator_type::sample_type& path =
+                generator_.next();
+            Real weight = path.weight;
+            pricer_(path.value, values_.begin());
+            if (antitheticVariate_) {
+                pricer_(generator_.antithetic().value,
+                        antitheticValues_.begin());
+                for (Size i=0; i<n; ++i)
+                    values_[i] = (values_[i] + antitheticValues_[i])/2.0;
+            }
+            for (Size i=0; i<n; ++i)
+                statistics_[i].add(values_[i], weight);
+        }
+        samples_ += samples;
+    }
+
+    template <class RNG, class S>
+    inline void MCMultiPayoffSimulation_2<RNG,S>::addSamplesToTolerance(
+                                                          Real tolerance,
+                                                          Size maxSamples) {
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy "
+                   "does not allow an error estimate");
+        QL_REQUIRE(tolerance > 0.0, "positive tolerance required");
+        const Size minSamples = 1023;
+
+        if (samples_ < minSamples)
+            addSamples(std::min(minSamples, maxSamples) - samples_);
+        Real error = maxErrorEstimate();
+        while (error > tolerance) {
+            QL_REQUIRE(samples_ < maxSamples,
+                       "max number of samples (" << maxSamples
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance (" << tolerance << ")");
+            Real order = (error*error)/tolerance/tolerance;
+            Size nextBatch = Size(std::max<Real>(
+                static_cast<Real>(samples_)*order*0.8
+                    - static_cast<Real>(samples_),
+                static_cast<Real>(minSamples)));
+            addSamples(std::min(nextBatch, maxSamples-samples_));
+            error = maxErrorEstimate();
+        }
+    }
+
+    template <class RNG, class S>
+    inline Array MCMultiPayoffSimulation_2<RNG,S>::values() const {
+        Array result(size());
+        for (Size i=0; i<size(); ++i)
+            result[i] = statistics_[i].mean();
+        return result;
+    }
+
+    template <class RNG, class S>
+    inline Array MCMultiPayoffSimulation_2<RNG,S>::errorEstimates() const {
+        Array result(size());
+        for (Size i=0; i<size(); ++i)
+            result[i] = statistics_[i].errorEstimate();
+        return result;
+    }
+
+    template <class RNG, class S>
+    inline Real MCMultiPayoffSimulation_2<RNG,S>::maxErrorEstimate() const {
+        Real error = 0.0;
+        for (Size i=0; i<size(); ++i)
+            error = std::max(error, statistics_[i].errorEstimate());
+        return error;
+    }
+
+}
+
+
+#endif
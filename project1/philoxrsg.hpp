@@ -0,0 +1,205 @@
+/*! \file philoxrsg.hpp
+    \brief Counter-based Philox random-sequence generator
+*/
+
+#ifndef philox_rsg_hpp
+#define philox_rsg_hpp
+
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/math/randomnumbers/inversecumulativersg.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        //! Philox-4x32-10 bijection of Salmon et al.
+        /*! Maps a 128-bit counter to 128 random bits under a 64-bit
+            key.  The function is branch-free, so that loops calling
+            it on consecutive counters can be vectorized.
+        */
+        inline void philox4x32(boost::uint32_t c[4],
+                               boost::uint32_t k0, boost::uint32_t k1) {
+            const boost::uint32_t m0 = 0xD2511F53U, m1 = 0xCD9E8D57U;
+            const boost::uint32_t w0 = 0x9E3779B9U, w1 = 0xBB67AE85U;
+            for (int round = 0; round < 10; ++round) {
+                boost::uint64_t p0 = boost::uint64_t(m0) * c[0];
+                boost::uint64_t p1 = boost::uint64_t(m1) * c[2];
+                boost::uint32_t hi0 = boost::uint32_t(p0 >> 32);
+                boost::uint32_t hi1 = boost::uint32_t(p1 >> 32);
+                c[0] = hi1 ^ c[1] ^ k0;
+                c[1] = boost::uint32_t(p1);
+                c[2] = hi0 ^ c[3] ^ k1;
+                c[3] = boost::uint32_t(p0);
+                k0 += w0;
+                k1 += w1;
+            }
+        }
+
+    }
+
+    //! Counter-based uniform random-sequence generator
+    /*! Coordinate \f$ d \f$ of path \f$ p \f$ is taken from the
+        Philox-4x32-10 output for the counter
+        \f$ (\lfloor d/4 \rfloor, 0, p_{lo}, p_{hi}) \f$ and the key
+        given by the seed; its value can therefore be computed
+        directly, without generating the preceding ones.  Any subset
+        of paths can be drawn on any thread or process, in any order,
+        with identical results.
+
+        nextSequence() returns consecutive paths starting from the
+        one passed to the constructor or to skipTo().  fill() draws
+        a block of paths in structure-of-arrays layout, four
+        dimensions per Philox call, with a loop over paths that the
+        compiler can vectorize.
+
+        As for MersenneTwisterUniformRng, 32-bit integers are mapped
+        to the centers of their cells in (0,1).
+    */
+    class PhiloxUniformRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit PhiloxUniformRsg(Size dimensionality,
+                                  BigNatural seed = 0,
+                                  boost::uint64_t firstPath = 0)
+        : dimensionality_(dimensionality), path_(firstPath),
+          sequence_(std::vector<Real>(dimensionality), 1.0) {
+            QL_REQUIRE(dimensionality > 0, "null dimensionality given");
+            boost::uint64_t s = (seed != 0 ? seed :
+                                 SeedGenerator::instance().get());
+            key0_ = boost::uint32_t(s);
+            key1_ = boost::uint32_t(s >> 32);
+        }
+        //! \name Sequence interface
+        //@{
+        const sample_type& nextSequence() const {
+            for (Size d=0; d<dimensionality_; d+=4) {
+                boost::uint32_t c[4];
+                counter(path_, d/4, c);
+                detail::philox4x32(c, key0_, key1_);
+                for (Size i=0; i<4 && d+i<dimensionality_; ++i)
+                    sequence_.value[d+i] = toReal(c[i]);
+            }
+            ++path_;
+            return sequence_;
+        }
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+        //@}
+        //! \name Random access
+        //@{
+        //! sets the path returned by the next call to nextSequence()
+        void skipTo(boost::uint64_t path) { path_ = path; }
+        boost::uint64_t nextPath() const { return path_; }
+        //! coordinate of the given path
+        Real operator()(boost::uint64_t path, Size dimension) const {
+            boost::uint32_t c[4];
+            counter(path, dimension/4, c);
+            detail::philox4x32(c, key0_, key1_);
+            return toReal(c[dimension%4]);
+        }
+        /*! writes the coordinates of the given paths so that
+            coordinate d of path firstPath+j is out[d*stride+j] */
+        template <class T>
+        void fill(boost::uint64_t firstPath, Size paths,
+                  T* out, Size stride) const {
+            QL_REQUIRE(stride >= paths, "stride smaller than paths");
+            for (Size d=0; d<dimensionality_; d+=4) {
+                Size lanes = std::min<Size>(4, dimensionality_-d);
+                for (Size j=0; j<paths; ++j) {
+                    boost::uint32_t c[4];
+                    counter(firstPath+j, d/4, c);
+                    detail::philox4x32(c, key0_, key1_);
+                    for (Size i=0; i<lanes; ++i)
+                        out[(d+i)*stride+j] = T(toReal(c[i]));
+                }
+            }
+        }
+        //@}
+      private:
+        static void counter(boost::uint64_t path, Size block,
+                            boost::uint32_t c[4]) {
+            c[0] = boost::uint32_t(block);
+            c[1] = 0;
+            c[2] = boost::uint32_t(path);
+            c[3] = boost::uint32_t(path >> 32);
+        }
+        static Real toReal(boost::uint32_t x) {
+            return (Real(x) + 0.5)/4294967296.0;
+        }
+        Size dimensionality_;
+        boost::uint32_t key0_, key1_;
+        mutable boost::uint64_t path_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! Gaussian random-sequence generator over Philox uniforms
+    /*! Same as InverseCumulativeRsg, but the underlying path can be
+        set with skipTo(), so that a generator can be moved to another
+        block of paths without being rebuilt.
+    */
+    template <class IC>
+    class CounterBasedRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit CounterBasedRsg(const PhiloxUniformRsg& generator,
+                                 const IC& inverseCumulative = IC())
+        : generator_(generator), inverseCumulative_(inverseCumulative),
+          x_(std::vector<Real>(generator.dimension()), 1.0) {}
+        const sample_type& nextSequence() const {
+            const PhiloxUniformRsg::sample_type& sample =
+                generator_.nextSequence();
+            x_.weight = sample.weight;
+            for (Size i=0; i<x_.value.size(); ++i)
+                x_.value[i] = inverseCumulative_(sample.value[i]);
+            return x_;
+        }
+        const sample_type& lastSequence() const { return x_; }
+        Size dimension() const { return generator_.dimension(); }
+        void skipTo(boost::uint64_t path) { generator_.skipTo(path); }
+      private:
+        PhiloxUniformRsg generator_;
+        IC inverseCumulative_;
+        mutable sample_type x_;
+    };
+
+
+    //! counter-based pseudo-random traits
+    /*! The generators can start from any path, so that engines can
+        split a run among threads or processes without skipping
+        ahead.
+    */
+    template <class IC>
+    struct GenericCounterBased {
+        // typedefs
+        typedef PhiloxUniformRsg ursg_type;
+        typedef CounterBasedRsg<IC> rsg_type;
+        // more traits
+        enum { allowsErrorEstimate = 1 };
+        // factory
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed) {
+            ursg_type g(dimension, seed);
+            return rsg_type(g);
+        }
+        //! returns a generator starting from the given path
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                boost::uint64_t firstPath) {
+            ursg_type g(dimension, seed, firstPath);
+            return rsg_type(g);
+        }
+    };
+
+    //! default counter-based traits
+    typedef GenericCounterBased<InverseCumulativeNormal> CounterBased;
+
+}
+
+
+#endif
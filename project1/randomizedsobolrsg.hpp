@@ -0,0 +1,120 @@
+/*! \file randomizedsobolrsg.hpp
+    \brief randomized Sobol low-discrepancy sequence
+*/
+
+#ifndef randomized_sobol_rsg_hpp
+#define randomized_sobol_rsg_hpp
+
+#include <ql/math/randomnumbers/sobolrsg.hpp>
+#include <ql/math/randomnumbers/inversecumulativersg.hpp>
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include "reseedablersg.hpp"
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Randomized Sobol low-discrepancy sequence
+    /*! Each point of the underlying Sobol sequence is scrambled by a
+        random digital shift, i.e., its 32-bit integer coordinates are
+        xor-ed with random integers drawn once per dimension from the
+        given seed.  Every replica built with a different seed is an
+        independent randomization of the same point set, so that the
+        spread of the estimates across replicas provides an unbiased
+        error estimate while each replica keeps the low-discrepancy
+        properties of the Sobol sequence.
+
+        The integer coordinates are mapped to the centers of their
+        cells, so that neither 0 nor 1 are ever returned.
+
+        The underlying sequence is the same for all replicas; direction
+        integers for dimensions that are not tabulated are initialized
+        with a fixed seed for this reason.  reseed() turns an instance
+        into another replica without allocating, by copying back the
+        initial state of the sequence.
+    */
+    class RandomizedSobolRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        RandomizedSobolRsg(Size dimensionality,
+                           BigNatural seed,
+                           SobolRsg::DirectionIntegers directionIntegers =
+                                                            SobolRsg::Jaeckel)
+        : dimensionality_(dimensionality),
+          start_(dimensionality, 42, directionIntegers), sobol_(start_),
+          shift_(dimensionality),
+          sequence_(std::vector<Real>(dimensionality), 1.0) {
+            reseed(seed);
+        }
+        //! skips to the n-th point of the underlying Sobol sequence
+        void skipTo(boost::uint32_t n) { sobol_.skipTo(n); }
+        /*! restarts as a new generator with the given seed would,
+            i.e., at the start of the sequence */
+        void reseed(BigNatural seed) {
+            // the assignment reuses the storage of the sequence
+            sobol_ = start_;
+            MersenneTwisterUniformRng_2 rng(seed);
+            for (Size i=0; i<dimensionality_; ++i)
+                shift_[i] = rng.nextInt32();
+        }
+        const sample_type& nextSequence() const {
+            const std::vector<boost::uint32_t>& v =
+                sobol_.nextInt32Sequence();
+            const Real normalizationFactor = 1.0/4294967296.0;
+            for (Size i=0; i<dimensionality_; ++i)
+                sequence_.value[i] =
+                    (Real(v[i] ^ shift_[i]) + 0.5) * normalizationFactor;
+            return sequence_;
+        }
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+      private:
+        Size dimensionality_;
+        SobolRsg start_;
+        mutable SobolRsg sobol_;
+        std::vector<boost::uint32_t> shift_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! randomized quasi-Monte Carlo traits
+    /*! As with GenericLowDiscrepancy, the samples are not
+        independent and their variance gives no error estimate, so
+        allowsErrorEstimate is false.  Engines that deal blocks of
+        samples to independently randomized replicas (see
+        detail::McBlockSequence in mceuropeanengine.hpp) can take the
+        error from the spread across replicas instead.
+    */
+    template <class IC>
+    struct GenericRandomizedLowDiscrepancy {
+        // typedefs
+        typedef RandomizedSobolRsg ursg_type;
+        typedef InverseCumulativeRsg<ursg_type,IC> rsg_type;
+        // more traits
+        enum { allowsErrorEstimate = 0 };
+        // factory
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed) {
+            ursg_type g(dimension, seed);
+            return rsg_type(g);
+        }
+        /*! returns a generator of the replica with the given seed,
+            starting from the given point of the Sobol sequence */
+        static rsg_type make_sequence_generator(Size dimension,
+                                                BigNatural seed,
+                                                Size firstPoint) {
+            ursg_type g(dimension, seed);
+            g.skipTo(boost::uint32_t(firstPoint));
+            return rsg_type(g);
+        }
+    };
+
+    //! default randomized quasi-Monte Carlo traits
+    typedef GenericRandomizedLowDiscrepancy<InverseCumulativeNormal>
+                                                    RandomizedLowDiscrepancy;
+
+}
+
+
+#endif
@@ -0,0 +1,117 @@
+/*! \file reseedablersg.hpp
+    \brief Random-sequence generators that can be reseeded in place
+*/
+
+#ifndef reseedable_rsg_hpp
+#define reseedable_rsg_hpp
+
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <ql/errors.hpp>
+#include <boost/cstdint.hpp>
+#include <random>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Mersenne-twister uniform generator that can be reseeded
+    /*! Draws the same numbers as MersenneTwisterUniformRng built
+        with the same seed; both implement the reference MT19937
+        initialization and tempering.  The state is held in the
+        object instead of the heap, so that neither reseed() nor
+        building an instance allocates.
+    */
+    class MersenneTwisterUniformRng_2 {
+      public:
+        typedef Sample<Real> sample_type;
+        //! a null seed is replaced by one from SeedGenerator
+        explicit MersenneTwisterUniformRng_2(unsigned long seed = 0) {
+            reseed(seed);
+        }
+        void reseed(unsigned long seed) {
+            if (seed == 0)
+                seed = SeedGenerator::instance().get();
+            engine_.seed(seed & 0xffffffffUL);
+        }
+        //! returns a sample with weight 1.0 in the (0,1) interval
+        sample_type next() const { return sample_type(nextReal(), 1.0); }
+        Real nextReal() const {
+            return (Real(nextInt32()) + 0.5)/4294967296.0;
+        }
+        boost::uint32_t nextInt32() const {
+            return boost::uint32_t(engine_());
+        }
+      private:
+        mutable std::mt19937 engine_;
+    };
+
+
+    //! Random sequence generator that can be reseeded
+    /*! Same as RandomSequenceGenerator, for uniform generators with
+        a reseed() method.
+    */
+    template <class RNG>
+    class RandomSequenceGenerator_2 {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        RandomSequenceGenerator_2(Size dimensionality, BigNatural seed)
+        : dimensionality_(dimensionality), rng_(seed),
+          sequence_(std::vector<Real>(dimensionality), 1.0) {
+            QL_REQUIRE(dimensionality > 0,
+                       "dimensionality must be greater than 0");
+        }
+        const sample_type& nextSequence() const {
+            sequence_.weight = 1.0;
+            for (Size i=0; i<dimensionality_; ++i) {
+                typename RNG::sample_type x(rng_.next());
+                sequence_.value[i] = x.value;
+                sequence_.weight *= x.weight;
+            }
+            return sequence_;
+        }
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimensionality_; }
+        //! restarts the sequence as a new generator with the given seed
+        void reseed(BigNatural seed) { rng_.reseed(seed); }
+      private:
+        Size dimensionality_;
+        RNG rng_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! Inverse-cumulative random sequence generator
+    /*! Same as InverseCumulativeRsg, but the uniform generator can be
+        reached, e.g., to reseed it or to move it to another point of
+        its sequence without building a new one.
+    */
+    template <class USG, class IC>
+    class InverseCumulativeRsg_2 {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit InverseCumulativeRsg_2(const USG& uniformSequenceGenerator,
+                                        const IC& inverseCumulative = IC())
+        : generator_(uniformSequenceGenerator),
+          inverseCumulative_(inverseCumulative),
+          x_(std::vector<Real>(generator_.dimension()), 1.0) {}
+        const sample_type& nextSequence() const {
+            const typename USG::sample_type& sample =
+                generator_.nextSequence();
+            x_.weight = sample.weight;
+            for (Size i=0; i<x_.value.size(); ++i)
+                x_.value[i] = inverseCumulative_(sample.value[i]);
+            return x_;
+        }
+        const sample_type& lastSequence() const { return x_; }
+        Size dimension() const { return generator_.dimension(); }
+        USG& uniformSequenceGenerator() { return generator_; }
+      private:
+        USG generator_;
+        IC inverseCumulative_;
+        mutable sample_type x_;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,309 @@
+/*! \file streamingstatistics.hpp
+    \brief Constant-memory, mergeable statistics of a sample
+*/
+
+#ifndef streaming_statistics_hpp
+#define streaming_statistics_hpp
+
+#include <ql/errors.hpp>
+#include <ql/types.hpp>
+#include <ql/mathconstants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Fixed-size sketch of the distribution of a sample
+    /*! The sample is summarized by weighted centroids, merged as in
+        the t-digest so that their number never exceeds a bound set
+        by the compression; centroids are smaller in the tails, where
+        quantiles need to be more accurate.  Sketches built on
+        different parts of a sample can be merged.
+
+        Memory is allocated once, when the sketch is built.
+    */
+    class QuantileSketch {
+      public:
+        explicit QuantileSketch(Size compression = 200)
+        : compression_(compression) {
+            QL_REQUIRE(compression > 0, "null compression given");
+            centroids_.reserve(capacity());
+            reset();
+        }
+        //! \name Inspectors
+        //@{
+        Size compression() const { return compression_; }
+        Real weightSum() const { return weightSum_; }
+        Real min() const { return min_; }
+        Real max() const { return max_; }
+        /*! returns the approximate value below which lies the given
+            fraction of the total weight */
+        Real quantile(Real p) const {
+            QL_REQUIRE(p >= 0.0 && p <= 1.0,
+                       "quantile (" << p << ") must be in [0.0, 1.0]");
+            QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+            compress();
+
+            const Centroid& first = centroids_.front();
+            const Centroid& last = centroids_.back();
+            Real target = p*weightSum_;
+            // tails are interpolated with the exact extremes
+            if (target <= first.weight/2.0)
+                return min_ + (first.mean - min_)*target/(first.weight/2.0);
+            if (target >= weightSum_ - last.weight/2.0)
+                return last.mean + (max_ - last.mean)
+                    * (target - weightSum_ + last.weight/2.0)
+                    / (last.weight/2.0);
+
+            Real center = first.weight/2.0;
+            for (Size i=1; i<centroids_.size(); ++i) {
+                Real next = center + (centroids_[i-1].weight
+                                      + centroids_[i].weight)/2.0;
+                if (target <= next)
+                    return centroids_[i-1].mean
+                        + (centroids_[i].mean - centroids_[i-1].mean)
+                        * (target - center) / (next - center);
+                center = next;
+            }
+            return last.mean;
+        }
+        //@}
+        //! \name Modifiers
+        //@{
+        void add(Real value, Real weight = 1.0) {
+            if (weight == 0.0)
+                return;
+            min_ = std::min(min_, value);
+            max_ = std::max(max_, value);
+            addCentroid(value, weight);
+        }
+        void merge(const QuantileSketch& other) {
+            if (other.weightSum_ == 0.0)
+                return;
+            other.compress();
+            min_ = std::min(min_, other.min_);
+            max_ = std::max(max_, other.max_);
+            for (Size i=0; i<other.centroids_.size(); ++i)
+                addCentroid(other.centroids_[i].mean,
+                            other.centroids_[i].weight);
+        }
+        void reset() {
+            centroids_.clear();
+            descending_ = false;
+            weightSum_ = 0.0;
+            min_ = QL_MAX_REAL;
+            max_ = QL_MIN_REAL;
+        }
+        //@}
+      private:
+        struct Centroid {
+            Real mean, weight;
+            bool operator<(const Centroid& other) const {
+                return mean < other.mean;
+            }
+        };
+        // after compression, no more than about compression_
+        // centroids are left; the rest is buffer space
+        Size capacity() const { return 5*compression_ + 1; }
+        // k1 scale function of the t-digest
+        Real scale(Real q) const {
+            return compression_/(2.0*M_PI)
+                * std::asin(2.0*std::min<Real>(q, 1.0) - 1.0);
+        }
+        void addCentroid(Real mean, Real weight) {
+            if (centroids_.size() == capacity())
+                compress();
+            Centroid c = { mean, weight };
+            centroids_.push_back(c);
+            weightSum_ += weight;
+        }
+        void compress() const {
+            if (centroids_.size() <= 1)
+                return;
+            std::sort(centroids_.begin(), centroids_.end());
+            // merging alternately from each end avoids biasing the
+            // centroids towards one of the tails
+            descending_ = !descending_;
+            if (descending_)
+                std::reverse(centroids_.begin(), centroids_.end());
+            Real cumulative = 0.0;
+            Real kLeft = scale(0.0);
+            Size last = 0;
+            for (Size i=1; i<centroids_.size(); ++i) {
+                Real proposed = centroids_[last].weight
+                              + centroids_[i].weight;
+                if (scale((cumulative + proposed)/weightSum_) - kLeft
+                                                                <= 1.0) {
+                    centroids_[last].mean +=
+                        (centroids_[i].mean - centroids_[last].mean)
+                        * centroids_[i].weight / proposed;
+                    centroids_[last].weight = proposed;
+                } else {
+                    cumulative += centroids_[last].weight;
+                    kLeft = scale(cumulative/weightSum_);
+                    centroids_[++last] = centroids_[i];
+                }
+            }
+            centroids_.resize(last+1);
+            if (descending_)
+                std::reverse(centroids_.begin(), centroids_.end());
+        }
+        Size compression_;
+        mutable std::vector<Centroid> centroids_;
+        mutable bool descending_;
+        Real weightSum_, min_, max_;
+    };
+
+
+    //! Constant-memory statistics of a sample
+    /*! Mean and variance are updated with the weighted version of
+        Welford's algorithm; third and fourth central moments are
+        also tracked if \c HigherMoments is true.  Percentiles are
+        estimated by a QuantileSketch.  No sample is stored, so that
+        memory doesn't grow with the number of samples.
+
+        Two instances accumulated on different parts of a sample can
+        be merged; moments are combined exactly (up to round-off) by
+        the pairwise formulas of Chan et al. and Pébay.
+
+        The class can be used as the statistics policy of the Monte
+        Carlo engines instead of Statistics.
+    */
+    template <bool HigherMoments = false>
+    class GenericStreamingStatistics {
+      public:
+        typedef Real value_type;
+        explicit GenericStreamingStatistics(Size compression = 200)
+        : sketch_(compression) {
+            reset();
+        }
+        //! \name Inspectors
+        //@{
+        Size samples() const { return samples_; }
+        Real weightSum() const { return weightSum_; }
+        Real mean() const {
+            QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+            return mean_;
+        }
+        Real variance() const {
+            QL_REQUIRE(samples_ > 1,
+                       "sample number <= 1, unsufficient");
+            Real n = static_cast<Real>(samples_);
+            return m2_/weightSum_ * n/(n-1.0);
+        }
+        Real standardDeviation() const {
+            return std::sqrt(variance());
+        }
+        Real errorEstimate() const {
+            return std::sqrt(variance()/samples_);
+        }
+        Real skewness() const {
+            QL_REQUIRE(HigherMoments, "higher moments not tracked");
+            QL_REQUIRE(samples_ > 2,
+                       "sample number <= 2, unsufficient");
+            Real sigma = standardDeviation();
+            if (sigma == 0.0)
+                return 0.0;
+            Real n = static_cast<Real>(samples_);
+            Real x = m3_/weightSum_;
+            return (x/(sigma*sigma*sigma))*(n/(n-1.0))*(n/(n-2.0));
+        }
+        Real kurtosis() const {
+            QL_REQUIRE(HigherMoments, "higher moments not tracked");
+            QL_REQUIRE(samples_ > 3,
+                       "sample number <= 3, unsufficient");
+            Real sigma2 = variance();
+            if (sigma2 == 0.0)
+                return 0.0;
+            Real n = static_cast<Real>(samples_);
+            Real x = m4_/weightSum_;
+            Real c1 = (n/(n-1.0)) * (n/(n-2.0)) * ((n+1.0)/(n-3.0));
+            Real c2 = 3.0 * ((n-1.0)/(n-2.0)) * ((n-1.0)/(n-3.0));
+            return c1*(x/(sigma2*sigma2)) - c2;
+        }
+        Real min() const {
+            QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+            return sketch_.min();
+        }
+        Real max() const {
+            QL_REQUIRE(weightSum_ > 0.0, "empty sample set");
+            return sketch_.max();
+        }
+        //! approximate value below which lies the fraction y of the weight
+        Real percentile(Real y) const {
+            QL_REQUIRE(y > 0.0 && y <= 1.0,
+                       "percentile (" << y << ") must be in (0.0, 1.0]");
+            return sketch_.quantile(y);
+        }
+        //! approximate value-at-risk at the given centile
+        Real valueAtRisk(Real centile) const {
+            QL_REQUIRE(centile >= 0.9 && centile < 1.0,
+                       "percentile (" << centile << ") out of range [0.9, 1.0)");
+            return -std::min<Real>(percentile(1.0-centile), 0.0);
+        }
+        const QuantileSketch& quantileSketch() const { return sketch_; }
+        //@}
+        //! \name Modifiers
+        //@{
+        void add(Real value, Real weight = 1.0) {
+            QL_REQUIRE(weight >= 0.0,
+                       "negative weight (" << weight << ") not allowed");
+            combine(1, weight, value, 0.0, 0.0, 0.0);
+            sketch_.add(value, weight);
+        }
+        template <class DataIterator>
+        void addSequence(DataIterator begin, DataIterator end) {
+            for (; begin != end; ++begin)
+                add(*begin);
+        }
+        template <class DataIterator, class WeightIterator>
+        void addSequence(DataIterator begin, DataIterator end,
+                         WeightIterator wbegin) {
+            for (; begin != end; ++begin, ++wbegin)
+                add(*begin, *wbegin);
+        }
+        //! adds the samples collected by another instance
+        void merge(const GenericStreamingStatistics& other) {
+            combine(other.samples_, other.weightSum_, other.mean_,
+                    other.m2_, other.m3_, other.m4_);
+            sketch_.merge(other.sketch_);
+        }
+        void reset() {
+            samples_ = 0;
+            weightSum_ = mean_ = m2_ = m3_ = m4_ = 0.0;
+            sketch_.reset();
+        }
+        //@}
+      private:
+        void combine(Size n, Real w, Real mean, Real m2, Real m3, Real m4) {
+            samples_ += n;
+            if (w == 0.0)
+                return;
+            Real wA = weightSum_, W = wA + w;
+            Real delta = mean - mean_, r = delta/W;
+            if (HigherMoments) {
+                m4_ += m4 + delta*r*r*r*wA*w*(wA*wA - wA*w + w*w)
+                     + 6.0*r*r*(wA*wA*m2 + w*w*m2_)
+                     + 4.0*r*(wA*m3 - w*m3_);
+                m3_ += m3 + delta*r*r*wA*w*(wA - w)
+                     + 3.0*r*(wA*m2 - w*m2_);
+            }
+            m2_ += m2 + delta*r*wA*w;
+            mean_ += r*w;
+            weightSum_ = W;
+        }
+        Size samples_;
+        Real weightSum_, mean_, m2_, m3_, m4_;
+        QuantileSketch sketch_;
+    };
+
+    //! streaming mean, variance and percentiles
+    typedef GenericStreamingStatistics<false> StreamingStatistics;
+    //! streaming statistics including skewness and kurtosis
+    typedef GenericStreamingStatistics<true> StreamingMomentStatistics;
+
+}
+
+
+#endif
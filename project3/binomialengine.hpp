@@ -33,14 +33,112 @@
 #include <ql/pricingengines/vanilla/discretizedvanillaoption.hpp>
 #include <ql/pricingengines/greeks.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
-#include <ql/termstructures/yield/flatforward.hpp>
-#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include "constantblackscholesprocess.hpp"
+#include <algorithm>
+#include <vector>
 
 namespace QuantLib {
 
+    //! values of a European option on a column of a binomial tree
+    /*! Returns the values on the nodes of the given column of a tree
+        with the given number of steps, constant branch
+        probabilities and constant discount factor per step, as
+        rolling back the payoff from the last column would.  The
+        value on node \f$ k \f$ is the discounted binomial sum
+        \f[
+        d^n \sum_j \binom{n}{j} p_u^j p_d^{n-j} f(S_{N,k+j})
+        \f]
+        over the \f$ n \f$ remaining steps, which only takes
+        \f$ O(n) \f$ operations.
+
+        The binomial weights are computed by recursion from the most
+        likely node, where they can't underflow, and normalized by
+        their sum; this keeps them accurate to a few ulps, while
+        coefficients taken from log-gamma functions would lose about
+        \f$ \ln(n!) \f$ ulps.  The recursion stops where the weights
+        underflow, and the payoff is only evaluated on in-the-money
+        nodes, found by bisection.
+    */
+    template <class T>
+    Array europeanBinomialValues(const T& tree,
+                                 const PlainVanillaPayoff& payoff,
+                                 Size steps,
+                                 Size column,
+                                 DiscountFactor discount) {
+        QL_REQUIRE(column <= steps,
+                   "column " << column << " beyond step " << steps);
+        Real pd = tree.probability(0, 0, 0), pu = tree.probability(0, 0, 1);
+        Size n = steps - column;
+        Array values(column+1, 0.0);
+
+        // binomial weights, relative to the most likely node
+        std::vector<Real> weights(n+1, 0.0);
+        Size mode = std::min<Size>(Size((n+1)*pu), n);
+        if (pu == 0.0)
+            mode = 0;
+        else if (pd == 0.0)
+            mode = n;
+        weights[mode] = 1.0;
+        Size low = mode, high = mode;
+        while (low > 0 && pu > 0.0) {
+            Real w = weights[low] * low/(n-low+1) * (pd/pu);
+            if (w == 0.0)
+                break;
+            weights[--low] = w;
+        }
+        while (high < n && pd > 0.0) {
+            Real w = weights[high] * (n-high)/(high+1) * (pu/pd);
+            if (w == 0.0)
+                break;
+            weights[++high] = w;
+        }
+        Real total = 0.0;
+        for (Size j=low; j<=high; ++j)
+            total += weights[j];
+
+        // first terminal node above the strike
+        Size first = 0, last = steps+1;
+        while (first < last) {
+            Size middle = (first+last)/2;
+            if (tree.underlying(steps, middle) > payoff.strike())
+                last = middle;
+            else
+                first = middle+1;
+        }
+        // payoffs of the in-the-money nodes reached from the column
+        Size begin = low, end = high+column+1;
+        if (payoff.optionType() == Option::Call)
+            begin = std::max(begin, first);
+        else
+            end = std::min(end, first);
+        std::vector<Real> payoffs(end > begin ? end-begin : 0);
+        for (Size i=0; i<payoffs.size(); ++i)
+            payoffs[i] = payoff(tree.underlying(steps, begin+i));
+
+        Real factor = std::pow(discount, Real(n))/total;
+        for (Size k=0; k<=column; ++k) {
+            // nodes k+j with begin <= k+j < end
+            Size from = std::max(low, begin > k ? begin-k : 0);
+            Size to = std::min(high+1, end > k ? end-k : 0);
+            Real sum = 0.0;
+            for (Size j=from; j<to; ++j)
+                sum += weights[j] * payoffs[k+j-begin];
+            values[k] = sum*factor;
+        }
+        return values;
+    }
+
+
     //! Pricing engine for vanilla options using binomial trees
     /*! \ingroup vanillaengines
 
+        For European options, the values on the second step of the
+        tree are computed in \f$ O(N) \f$ by
+        europeanBinomialValues() instead of rolling back the whole
+        tree, and agree with the rollback to a few ulps; this makes
+        trees with \f$ 10^5 \f$ steps or more affordable.  The last
+        two steps are rolled back as usual for the Greeks.
+
         \test the correctness of the returned values is tested by
               checking it against analytic results.
 
@@ -76,8 +174,6 @@ namespace QuantLib {
 
         DayCounter rfdc  = process_->riskFreeRate()->dayCounter();
         DayCounter divdc = process_->dividendYield()->dayCounter();
-        DayCounter voldc = process_->blackVolatility()->dayCounter();
-        Calendar volcal = process_->blackVolatility()->calendar();
 
         Real s0 = process_->stateVariable()->value();
         QL_REQUIRE(s0 > 0.0, "negative or null underlying given");
@@ -90,27 +186,15 @@ namespace QuantLib {
             divdc, Continuous, NoFrequency);
         Date referenceDate = process_->riskFreeRate()->referenceDate();
 
-        // binomial trees with constant coefficient
-        Handle<YieldTermStructure> flatRiskFree(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, r, rfdc)));
-        Handle<YieldTermStructure> flatDividends(
-            boost::shared_ptr<YieldTermStructure>(
-                new FlatForward(referenceDate, q, divdc)));
-        Handle<BlackVolTermStructure> flatVol(
-            boost::shared_ptr<BlackVolTermStructure>(
-                new BlackConstantVol(referenceDate, volcal, v, voldc)));
-
         boost::shared_ptr<PlainVanillaPayoff> payoff =
             boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
         QL_REQUIRE(payoff, "non-plain payoff given");
 
         Time maturity = rfdc.yearFraction(referenceDate, maturityDate);
 
+        // binomial trees with constant coefficient
         boost::shared_ptr<StochasticProcess1D> bs(
-                         new GeneralizedBlackScholesProcess(
-                                      process_->stateVariable(),
-                                      flatDividends, flatRiskFree, flatVol));
+                         new ConstantBlackScholesProcess(s0, q, r, v));
 
         TimeGrid grid(maturity, timeSteps_);
 
@@ -122,7 +206,11 @@ namespace QuantLib {
 
         DiscretizedVanillaOption option(arguments_, *process_, grid);
 
-        option.initialize(lattice, maturity);
+        bool european =
+            arguments_.exercise->type() == Exercise::European;
+        Real pd = tree->probability(0, 0, 0);
+        Real pu = tree->probability(0, 0, 1);
+        DiscountFactor discount = lattice->discount(0, 0);
 
         // Partial derivatives calculated from various points in the
         // binomial tree 
@@ -130,8 +218,15 @@ namespace QuantLib {
 
         // Rollback to third-last step, and get underlying prices (s2) &
         // option values (p2) at this point
-        option.rollback(grid[2]);
-        Array va2(option.values());
+        Array va2;
+        if (european) {
+            va2 = europeanBinomialValues(*tree, *payoff, timeSteps_, 2,
+                                         discount);
+        } else {
+            option.initialize(lattice, maturity);
+            option.rollback(grid[2]);
+            va2 = option.values();
+        }
         QL_ENSURE(va2.size() == 3, "Expect 3 nodes in grid at second step");
         Real p2u = va2[2]; // up
         Real p2m = va2[1]; // mid
@@ -147,8 +242,15 @@ namespace QuantLib {
 
         // Rollback to second-last step, and get option values (p1) at
         // this point
-        option.rollback(grid[1]);
-        Array va(option.values());
+        Array va(2);
+        if (european) {
+            // same step as the lattice
+            for (Size j=0; j<2; ++j)
+                va[j] = (pd*va2[j] + pu*va2[j+1])*discount;
+        } else {
+            option.rollback(grid[1]);
+            va = option.values();
+        }
         QL_ENSURE(va.size() == 2, "Expect 2 nodes in grid at first step");
         Real p1u = va[1];
         Real p1d = va[0];
@@ -158,8 +260,13 @@ namespace QuantLib {
         Real delta = (p1u - p1d) / (s1u - s1d);
 
         // Finally, rollback to t=0
-        option.rollback(0.0);
-        Real p0 = option.presentValue();
+        Real p0;
+        if (european) {
+            p0 = (pd*va[0] + pu*va[1])*discount;
+        } else {
+            option.rollback(0.0);
+            p0 = option.presentValue();
+        }
 
         // Store results
         results_.value = p0;
@@ -3,15 +3,116 @@
 #include "binomialengine.hpp"
 #include <ql/methods/lattices/binomialtree.hpp>
 #include <ql/pricingengines/vanilla/binomialengine.hpp>
+#include <ql/quantlib.hpp>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
+#include <string>
 
 using namespace QuantLib;
 
+namespace {
+
+    // prices the option with the closed-form European sums of
+    // BinomialVanillaEngine_2 and with the full rollback of the
+    // corresponding QuantLib engine
+    template <class Tree_2, class Tree>
+    void compare(const std::string& name,
+                 VanillaOption& option,
+                 const boost::shared_ptr<GeneralizedBlackScholesProcess>& p,
+                 Size steps) {
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                            new BinomialVanillaEngine_2<Tree_2>(p, steps)));
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        Real sum = option.NPV();
+        double sumTime = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                                new BinomialVanillaEngine<Tree>(p, steps)));
+        start = std::chrono::steady_clock::now();
+        Real rollback = option.NPV();
+        double rollbackTime = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        std::cout << std::setw(20) << std::left << name
+                  << std::fixed << std::setprecision(15)
+                  << std::setw(20) << std::left << sum
+                  << std::scientific << std::setprecision(2)
+                  << std::setw(12) << std::left << (sum - rollback)/rollback
+                  << std::fixed << std::setprecision(4)
+                  << std::setw(12) << std::left << sumTime
+                  << rollbackTime << std::endl;
+    }
+
+}
+
 int main() {
 
     try {
 
-        // add your code here
+        Calendar calendar = TARGET();
+        Date todaysDate(15, May, 1998);
+        Date settlementDate(17, May, 1998);
+        Settings::instance().evaluationDate() = todaysDate;
+
+        DayCounter dayCounter = Actual365Fixed();
+        Handle<Quote> underlyingH(
+            boost::shared_ptr<Quote>(new SimpleQuote(36.0)));
+        Handle<YieldTermStructure> flatTermStructure(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(settlementDate, 0.06, dayCounter)));
+        Handle<YieldTermStructure> flatDividendTS(
+            boost::shared_ptr<YieldTermStructure>(
+                new FlatForward(settlementDate, 0.00, dayCounter)));
+        Handle<BlackVolTermStructure> flatVolTS(
+            boost::shared_ptr<BlackVolTermStructure>(
+                new BlackConstantVol(settlementDate, calendar,
+                                     0.20, dayCounter)));
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process(
+            new BlackScholesMertonProcess(underlyingH, flatDividendTS,
+                                          flatTermStructure, flatVolTS));
+
+        VanillaOption option(
+            boost::shared_ptr<StrikedTypePayoff>(
+                new PlainVanillaPayoff(Option::Put, 40.0)),
+            boost::shared_ptr<Exercise>(
+                new EuropeanExercise(Date(17, May, 1999))));
+
+        Size stepCounts[] = { 1001, 10000 };
+        for (Size i=0; i<2; ++i) {
+            Size steps = stepCounts[i];
+            std::cout << std::endl << steps << " steps" << std::endl
+                      << std::setw(20) << std::left << "Tree"
+                      << std::setw(20) << std::left << "Binomial sum"
+                      << std::setw(12) << std::left << "vs. QL"
+                      << std::setw(12) << std::left << "Time (s)"
+                      << "Rollback (s)" << std::endl;
+            compare<JarrowRudd_2, JarrowRudd>(
+                "Jarrow-Rudd", option, process, steps);
+            compare<CoxRossRubinstein_2, CoxRossRubinstein>(
+                "Cox-Ross-Rubinstein", option, process, steps);
+            compare<AdditiveEQPBinomialTree_2, AdditiveEQPBinomialTree>(
+                "Additive EQP", option, process, steps);
+            compare<Trigeorgis_2, Trigeorgis>(
+                "Trigeorgis", option, process, steps);
+            compare<Tian_2, Tian>("Tian", option, process, steps);
+            compare<LeisenReimer_2, LeisenReimer>(
+                "Leisen-Reimer", option, process, steps);
+            compare<Joshi4_2, Joshi4>("Joshi", option, process, steps);
+        }
+
+        // a reference price, out of reach of the rollback
+        option.setPricingEngine(boost::shared_ptr<PricingEngine>(
+                new BinomialVanillaEngine_2<LeisenReimer_2>(process,
+                                                            100001)));
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        Real reference = option.NPV();
+        double seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+        std::cout << std::endl << "Leisen-Reimer, 100001 steps: "
+                  << std::setprecision(15) << reference << " ("
+                  << std::setprecision(4) << seconds << " s)" << std::endl;
 
         return 0;
 
@@ -23,4 +124,3 @@ int main() {
         return 1;
     }
 }
-
@@ -0,0 +1,76 @@
+
+/*! \file constantblackscholesprocess.hpp
+    \brief Black-Scholes process with constant parameters
+*/
+
+#ifndef constant_black_scholes_process_hpp
+#define constant_black_scholes_process_hpp
+
+#include <ql/stochasticprocess.hpp>
+
+namespace QuantLib {
+
+    //! Black-Scholes process with constant parameters
+    /*! This class describes the stochastic process \f$ S \f$ governed by
+        \f[
+            d\ln S(t) = (r - q - \frac{\sigma^2}{2}) dt + \sigma dW_t.
+        \f]
+        with constant \f$ r \f$, \f$ q \f$ and \f$ \sigma \f$.  As in
+        GeneralizedBlackScholesProcess, the drift and diffusion refer
+        to the logarithm of the underlying, so that the process can
+        be used in its place by trees and path generators; however,
+        no term structure is queried and the evolution is exact for
+        any time step.
+
+        \ingroup processes
+    */
+    class ConstantBlackScholesProcess : public StochasticProcess1D {
+      public:
+        ConstantBlackScholesProcess(Real x0,
+                                    Rate dividendYield,
+                                    Rate riskFreeRate,
+                                    Volatility volatility)
+        : x0_(x0), dividendYield_(dividendYield),
+          riskFreeRate_(riskFreeRate), volatility_(volatility),
+          drift_(riskFreeRate - dividendYield - 0.5*volatility*volatility) {
+            QL_REQUIRE(x0 > 0.0, "negative or null underlying given");
+            QL_REQUIRE(volatility >= 0.0, "negative volatility given");
+        }
+        //! \name StochasticProcess1D interface
+        //@{
+        Real x0() const { return x0_; }
+        Real drift(Time, Real) const { return drift_; }
+        Real diffusion(Time, Real) const { return volatility_; }
+        Real apply(Real x0, Real dx) const { return x0 * std::exp(dx); }
+        /*! \note this is the expected value of the underlying, not of
+                  its logarithm. */
+        Real expectation(Time, Real x0, Time dt) const {
+            return x0 * std::exp((riskFreeRate_ - dividendYield_)*dt);
+        }
+        Real stdDeviation(Time, Real, Time dt) const {
+            return volatility_ * std::sqrt(dt);
+        }
+        Real variance(Time, Real, Time dt) const {
+            return volatility_ * volatility_ * dt;
+        }
+        Real evolve(Time, Real x0, Time dt, Real dw) const {
+            return x0 * std::exp(drift_*dt + volatility_*std::sqrt(dt)*dw);
+        }
+        //@}
+        //! \name Inspectors
+        //@{
+        Rate dividendYield() const { return dividendYield_; }
+        Rate riskFreeRate() const { return riskFreeRate_; }
+        Volatility volatility() const { return volatility_; }
+        //@}
+      private:
+        Real x0_;
+        Rate dividendYield_, riskFreeRate_;
+        Volatility volatility_;
+        Real drift_;
+    };
+
+}
+
+
+#endif